@@ -1,688 +1,364 @@
 //James Marcel
 //filter library
+//cv::Mat adapters: each allocates dst if needed and runs the ImageView kernel in filterCore.cpp
 
 #include <cstdio>
 #include <cstring>
 #include <opencv2/opencv.hpp>
 #include "filter.h"
-
-
-//apply a 3x3 filter - datatype will be CV_16SC3
-//[-1 0 1]
-//[-2 0 2]
-//[-1 0 1]
-int gradX(cv::Mat &src, cv::Mat &dst) {
-
-	//allocate dst image - init to 0s
-	dst = cv::Mat::zeros(src.size(), CV_16SC3); //signed short data type
-
-	//loop over src and apply a 3x3 filter
-	for (int i = 1; i < src.rows - 1; i++) {
-
-		//src needs ptrs to rows above and below
-		cv::Vec3b *rptrm1 = src.ptr<cv::Vec3b>(i - 1);
-		cv::Vec3b *rptr = src.ptr<cv::Vec3b>(i);
-		cv::Vec3b *rptrp1 = src.ptr<cv::Vec3b>(i + 1);
-
-		//dst is short so we need to use Vec3s
-		cv::Vec3s *dptr = dst.ptr<cv::Vec3s>(i);
-
-		for (int j = 1; j < src.cols - 1; j++) {
-
-			//for each color channel
-			for (int c = 0; c < 3; c++) {
-				//summing filtered surrounding values
-				dptr[j][c] = ((-1 * rptrm1[j - 1][c]) + rptrp1[j + 1][c] +
-					(-2 * rptr[j - 1][c]) + (2 * rptr[j + 1][c]) +
-					(-1 * rptrp1[j - 1][c]) + rptrp1[j + 1][c]) / 4;
-			}
-
-		}
+#include "frameCache.h"
+
+//view of a Mat for the kernels. A Mat that is a window (ROI) into a bigger one gets the rest of
+//that as its halo, so the kernels use the real neighbours past its edges. Types the kernels don't
+//take give an empty view, which they refuse.
+static ImageView view(const cv::Mat& m) {
+
+	ImageFormat format;
+	switch (m.type()) {
+	case CV_8UC1:
+		format = IMAGE_GRAY8;
+		break;
+	case CV_8UC3:
+		format = IMAGE_BGR8;
+		break;
+	case CV_16SC3:
+		format = IMAGE_BGR16S;
+		break;
+	default:
+		return ImageView();
 	}
 
-	//return
-	return 0;
-}
-
-//grayScale averages the RGB values of each pixel and sets result in destination array as uchar
-int grayScale(cv::Mat& src, cv::Mat& dst) {
-
-	//allocate dst image - init to 0s
-	dst = cv::Mat::zeros(src.size(), CV_8U); //using 8 bit chars since we just need one color
-
-	//loop over source and avg the 3 color values to get a grayscale value
-	for (int i = 0; i < src.rows; i++) {
-
-		//src row pointer
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
-
-		//dst is short so we need to use Vec3s
-		uchar* dptr = dst.ptr<uchar>(i);
-
-		//going through each column of 
-		for (int j = 0; j < src.cols; j++) {
-
-			//averaging each vec3b into a single value to store in the dst
-			dptr[j] = (rptr[j][0] + rptr[j][1] + rptr[j][2]) / 3;
-
-		}
-
+	ImageView v(m.data, m.cols, m.rows, m.step, format);
+	if (!m.empty()) {
+		cv::Size whole;
+		cv::Point ofs;
+		m.locateROI(whole, ofs);
+		v.haloTop = ofs.y;
+		v.haloBottom = whole.height - ofs.y - m.rows;
+		v.haloLeft = ofs.x;
+		v.haloRight = whole.width - ofs.x - m.cols;
 	}
-
-
-	//return
-	return 0;
+	return v;
 }
 
+//allocates pyr as half, quarter, ... size (rounded down) copies of a size x CV_8UC3 frame and
+//returns views of them. The number of levels is the size pyr already has, or 2 (half and quarter)
+//if it is empty.
+static std::vector<ImageView> pyramidInit(cv::Size size, std::vector<cv::Mat>* pyr) {
 
-
-//blur filter is separable 1x5 and 5x1 filters ([1 2 4 2 1]) to approximate a 5x5 gaussian blur in the destination
-int blur5x5(cv::Mat& src, cv::Mat& dst) {
-
-
-	//allocate dst image - init to 0s
-	//dst2 is the first convolution, then calculations are written to dst for final result
-	cv::Mat dst2;
-	dst2 = cv::Mat::zeros(src.size(), CV_16FC3); //this space is for the first convolution
-	//allocating the destination image:
-	dst = cv::Mat::zeros(src.size(), src.type()); 
-
-
-
-	
-	//loop over src and apply the horizontal 
-	for (int i = 3; i < (src.rows - 3); i++) {
-
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
-
-		//dst is short so we need to use Vec3s
-		cv::Vec3s* dptr2 = dst2.ptr<cv::Vec3s>(i);
-
-
-		for (int j = 3; j < (src.cols - 3); j++) {
-
-
-				//for each color channel
-				for (int c = 0; c < 3; c++) {
-
-					//summing filtered surrounding values for horizontal [1 2 4 2 1] 1x5 filter
-					dptr2[j][c] = (rptr[j - 2][c] + (2 * rptr[j - 1][c]) +
-						(4 * rptr[j][c]) + (2 * rptr[j + 1][c]) + rptr[j + 2][c]);
-
-				}
-
-
-		}
-
+	std::vector<ImageView> levels;
+	if (pyr == nullptr) {
+		return levels;
 	}
-
-
-
-	// 2nd loop applies the 5x1 filter [1 2 4 2 1] and writes to final result destination
-	for (int i = 3; i < dst2.rows - 3; i++) {
-
-		//col pointers for updated source
-		cv::Vec3s* nrptrm2 = dst2.ptr<cv::Vec3s>(i - 2);
-		cv::Vec3s* nrptrm1 = dst2.ptr<cv::Vec3s>(i - 1);
-		cv::Vec3s* nrptr = dst2.ptr<cv::Vec3s>(i);
-		cv::Vec3s* nrptrp1 = dst2.ptr<cv::Vec3s>(i + 1);
-		cv::Vec3s* nrptrp2 = dst2.ptr<cv::Vec3s>(i + 2);
-
-		//col pointer for final destination
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
-
-		//for each row in this column
-		for (int j = 3; j < dst2.cols - 3; j++) {
-			for (int c = 0; c < 3; c++) {
-
-				//writing result to destination array (result divided by sum of gaussian array (100))
-				dptr[j][c] = (nrptrm2[j][c] + (2 * nrptrm1[j][c]) + (4 * nrptr[j][c]) +
-					(2 * nrptrp1[j][c]) + nrptrp2[j][c]) / 100;
-
-			}
-		}
+	if (pyr->empty()) {
+		pyr->resize(2);
 	}
-
-	//handling edge cases that can't be properly calculated by filter
-	for (int i = 0; i < src.rows; i++) {
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
-
-		//case for left and right edges
-		if ((i >= 6) && (i <= src.rows - 6)) {
-			for (int c = 0; c < 3; c++) {
-				dptr[0][c] = rptr[0][c];
-				dptr[1][c] = rptr[1][c];
-				dptr[2][c] = rptr[2][c];
-				dptr[src.cols - 3][c] = rptr[src.cols - 3][c];
-				dptr[src.cols - 2][c] = rptr[src.cols - 2][c];
-				dptr[src.cols - 1][c] = rptr[src.cols - 1][c];
-
-			}
-		}
-		//case for top and bottom edges
-		else {
-			for (int j = 0; j < src.cols; j++) {
-				for (int c = 0; c < 3; c++) {
-					dptr[j][c] = rptr[j][c];
-				}
-			}
-
-		}
-
+	for (size_t k = 0; k < pyr->size(); k++) {
+		size = cv::Size(size.width / 2, size.height / 2);
+		(*pyr)[k].create(size, CV_8UC3);
+		levels.push_back(view((*pyr)[k]));
 	}
-
-return 0;
+	return levels;
 }
 
 
-//implements X sobel 3x3 filter convolving [-1 0 1]horizontal and [1 2 1] vertical (positive right)
-int sobelX3x3(cv::Mat &src, cv::Mat &dst) {
-
-	//allocate dst image - init to 0s
-	//dst2 is the first convolution, then calculations are written to dst for final result
-	cv::Mat dst2;
-	dst2 = cv::Mat::zeros(src.size(), CV_16SC3); //this space is for the first convolution
-	//allocating the destination image:
-	dst = cv::Mat::zeros(src.size(), CV_16SC3); //signed short data type for passed destination
-
-	//loop over src and apply the horizontal 
-	for (int i = 2; i < (src.rows - 2); i++) {
-
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
-
-		//dst is short so we need to use Vec3s
-		cv::Vec3s* dptr2 = dst2.ptr<cv::Vec3s>(i);
-
-		for (int j = 2; j < (src.cols - 2); j++) {
-
-			//for each color channel
-			for (int c = 0; c < 3; c++) {
-
-				//summing filtered surrounding values for horizontal [-1 0 1] 1x3 filter
-				dptr2[j][c] = (-1 * rptr[j - 1][c]) + rptr[j + 1][c];
-
-			}
-		}
-	}
+//apply a 3x3 filter - datatype will be CV_16SC3 (CV_8UC3 absolute values with disp)
+//[-1 0 1]
+//[-2 0 2]
+//[-1 0 1]
+int gradX(cv::Mat &src, cv::Mat &dst, bool disp) {
 
-	// 2nd loop applies the 3x1 filter [1 2 1]
-	for (int i = 2; i < dst2.rows - 2; i++) {
+	dst.create(src.size(), disp ? CV_8UC3 : CV_16SC3); //signed short data type
+	return gradX(view(src), view(dst));
+}
 
-		//col pointer for updated source
-		cv::Vec3s* nrptrm1 = dst2.ptr<cv::Vec3s>(i - 1);
-		cv::Vec3s* nrptr = dst2.ptr<cv::Vec3s>(i);
-		cv::Vec3s* nrptrp1 = dst2.ptr<cv::Vec3s>(i + 1);
+//grayScale averages the RGB values of each pixel and sets result in destination array as uchar
+int grayScale(cv::Mat& src, cv::Mat& dst) {
 
-		//col pointer for final destination
-		cv::Vec3s* dptr = dst.ptr<cv::Vec3s>(i);
+	dst.create(src.size(), CV_8U); //using 8 bit chars since we just need one color
+	return grayScale(view(src), view(dst));
+}
 
-		//for each row in this column
-		for (int j = 2; j < dst2.cols - 2; j++) {
-			for (int c = 0; c < 3; c++) {
+//blur filter is separable 1x5 and 5x1 filters ([1 2 4 2 1]) to approximate a 5x5 gaussian blur in the destination
+int blur5x5(cv::Mat& src, cv::Mat& dst, std::vector<cv::Mat>* pyr) {
 
-				dptr[j][c] = ( nrptrm1[j][c] + (2 * nrptr[j][c]) + nrptrp1[j][c] );
+	dst.create(src.size(), CV_8UC3);
+	std::vector<ImageView> levels = pyramidInit(dst.size(), pyr);
+	return blur5x5(view(src), view(dst), levels.data(), static_cast<int>(levels.size()));
+}
 
-			}
-		}
-	}
+//implements X sobel 3x3 filter convolving [-1 0 1]horizontal and [1 2 1] vertical (positive right)
+int sobelX3x3(cv::Mat &src, cv::Mat &dst, bool disp) {
 
-	return 0;
+	dst.create(src.size(), disp ? CV_8UC3 : CV_16SC3); //signed short data type for passed destination
+	return sobelX3x3(view(src), view(dst));
 }
 
-
 //implements Y sobel 3x3 filter convolving [-1 0 1]vertical and [1 2 1] horizontal
 //works off same logic as X3x3 but positive down
-int sobelY3x3(cv::Mat &src, cv::Mat &dst) {
-
-	//allocate dst image - init to 0s
-	//dst2 is the first convolution, then calculations are written to dst for final result
-	cv::Mat dst2;
-	dst2 = cv::Mat::zeros(src.size(), CV_16SC3); //this space is for the first convolution
-	//allocating the destination image:
-	dst = cv::Mat::zeros(src.size(), CV_16SC3); //signed short data type for passed destination
-
-	//loop over src and apply the horizontal 
-	for (int i = 2; i < (src.rows - 2); i++) {
-
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
-
-		//dst is short so we need to use Vec3s
-		cv::Vec3s* dptr2 = dst2.ptr<cv::Vec3s>(i);
+int sobelY3x3(cv::Mat &src, cv::Mat &dst, bool disp) {
 
-		for (int j = 2; j < (src.cols - 2); j++) {
-
-			//for each color channel
-			for (int c = 0; c < 3; c++) {
-
-				//summing filtered surrounding values for horizontal [1 2 1] 1x3 filter
-				dptr2[j][c] =  rptr[j - 1][c] + (2 * rptr[j][c]) +  rptr[j + 1][c];
-
-			}
-		}
-	}
-
-	// 2nd loop applies the 3x1 filter [-1 0 1]
-	for (int i = 2; i < dst2.rows - 2; i++) {
-
-		//col pointer for updated source
-		cv::Vec3s* nrptrm1 = dst2.ptr<cv::Vec3s>(i - 1);
-		cv::Vec3s* nrptr = dst2.ptr<cv::Vec3s>(i);
-		cv::Vec3s* nrptrp1 = dst2.ptr<cv::Vec3s>(i + 1);
-
-		//col pointer for final destination
-		cv::Vec3s* dptr = dst.ptr<cv::Vec3s>(i);
-
-		//for each row in this column
-		for (int j = 2; j < dst2.cols - 2; j++) {
-			for (int c = 0; c < 3; c++) {
+	dst.create(src.size(), disp ? CV_8UC3 : CV_16SC3); //signed short data type for passed destination
+	return sobelY3x3(view(src), view(dst));
+}
 
-				dptr[j][c] = ( (- 1 * nrptrm1[j][c]) + nrptrp1[j][c] );
+//absolute values of a 16-bit sobel / gradX result, for display
+int absSaturate(cv::Mat &src, cv::Mat &dst) {
 
-			}
-		}
-	}
-
-	return 0;
+	dst.create(src.size(), CV_8UC3);
+	return absSaturate(view(src), view(dst));
 }
 
 //combines sobelx and sobely arrays to determine gradient magnitude of each pixel.
-//NOTE: I divided each result by 3 to give a less noisy image. Could be due to my webcam.
 int magnitude(cv::Mat &sx, cv::Mat &sy, cv::Mat &dst) {
 
-	dst = cv::Mat::zeros(sx.size(), CV_8UC3);
-
-	for (int i = 0; i < sx.rows; i++) {
-
-		//row pointers for sx and sy
-		cv::Vec3s* xptr = sx.ptr<cv::Vec3s>(i);
-		cv::Vec3s* yptr = sy.ptr<cv::Vec3s>(i);
-
-		//row pointer for destination
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
-
-		for (int j = 0; j < sx.cols; j++) {
-
-			for (int c = 0; c < 3; c++) {
+	dst.create(sx.size(), CV_8UC3);
+	return magnitude(view(sx), view(sy), view(dst));
+}
 
-				//NOTE: Initially the formula sqrt(sx*sx + sy*sy) was too sensitive on my camera, so i divided results by 3 for a more practical image
-				dptr[j][c] = sqrt((xptr[j][c] * xptr[j][c]) + (yptr[j][c] * yptr[j][c]))/3;
+//blurs the image but chooses one of 'levels' pixel values to quantize color
+int blurQuantize(cv::Mat& src, cv::Mat& dst, int levels, std::vector<cv::Mat>* pyr) {
 
-			}
-		}
+	dst.create(src.size(), CV_8UC3);
+	std::vector<ImageView> pyrLevels = pyramidInit(dst.size(), pyr);
+	return blurQuantize(view(src), view(dst), levels, pyrLevels.data(), static_cast<int>(pyrLevels.size()));
+}
 
-	}
+//quantize step of blurQuantize on an already blurred frame
+int quantize(cv::Mat& blurred, cv::Mat& dst, int levels) {
 
-	return 0;
+	dst.create(blurred.size(), CV_8UC3);
+	return quantize(view(blurred), view(dst), levels);
 }
 
-//blurs the image but chooses one of 'levels' pixel values to quantize color
-//Uses the same framework as gaussian blur, but added the bucket steps into the second full frame iteration to save
-//cpu from computing another full iteration
-int blurQuantize(cv::Mat& src, cv::Mat& dst, int levels) {
+//cartoon filter generates a color quantized frame and checks sobel magnitude for each pixel
+//In my implementation, pixels with a magnitude over the threshold are black, the rest are filled in from the quantized frame
+int cartoon(cv::Mat& src, cv::Mat& dst, int levels, int magThreshold, std::vector<cv::Mat>* pyr) {
 
-	float buckets = static_cast<float>(255) / levels;
+	dst.create(src.size(), CV_8UC3);
+	std::vector<ImageView> pyrLevels = pyramidInit(dst.size(), pyr);
+	return cartoon(view(src), view(dst), levels, magThreshold, pyrLevels.data(), static_cast<int>(pyrLevels.size()));
+}
 
-	//allocate dst image - init to 0s
-	//dst2 is the first convolution, then calculations are written to dst for final result
-	cv::Mat dst2;
-	dst2 = cv::Mat::zeros(src.size(), CV_16FC3); //this space is for the first convolution
-	//allocating the destination image:
-	dst = cv::Mat::zeros(src.size(), src.type());
+//cartoon of the cache's current frame, sharing its sobel and quantize results with other filters
+int cartoon(FrameCache& cache, cv::Mat& dst, int levels, int magThreshold, std::vector<cv::Mat>* pyr) {
 
-	//loop over src and apply the horizontal 
-	for (int i = 3; i < (src.rows - 3); i++) {
+	cv::Mat sx = cache.get(CACHE_SOBEL_X);
+	cv::Mat sy = cache.get(CACHE_SOBEL_Y);
+	cv::Mat quant = cache.get(CACHE_QUANTIZE, levels);
 
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
+	dst.create(quant.size(), CV_8UC3);
+	std::vector<ImageView> pyrLevels = pyramidInit(dst.size(), pyr);
+	return cartoonCombine(view(sx), view(sy), view(quant), view(dst), magThreshold,
+		pyrLevels.data(), static_cast<int>(pyrLevels.size()));
+}
 
-		//dst is short so we need to use Vec3s
-		cv::Vec3s* dptr2 = dst2.ptr<cv::Vec3s>(i);
+//gradient magnitude of the cache's current frame from its cached sobel results
+int magnitude(FrameCache& cache, cv::Mat& dst) {
 
-		for (int j = 3; j < (src.cols - 3); j++) {
+	cv::Mat sx = cache.get(CACHE_SOBEL_X);
+	cv::Mat sy = cache.get(CACHE_SOBEL_Y);
+	return magnitude(sx, sy, dst);
+}
 
-			//for each color channel
-			for (int c = 0; c < 3; c++) {
+//spacing of the pixels cartoonKeyframed compares to decide whether the scene changed
+static const int SAMPLE_STEP = 8;
 
-				//summing filtered surrounding values for horizontal [1 2 4 2 1] 1x5 filter
-				dptr2[j][c] = (rptr[j - 2][c] + (2 * rptr[j - 1][c]) +
-					(4 * rptr[j][c]) + (2 * rptr[j + 1][c]) + rptr[j + 2][c]);
+//mean absolute difference (0-255) between src and the samples taken when the mask was computed
+static double sampleDiff(const cv::Mat& src, const std::vector<uchar>& samples) {
 
+	int64_t sum = 0;
+	size_t k = 0;
+	for (int i = 0; i < src.rows; i += SAMPLE_STEP) {
+		const uchar* rptr = src.ptr<uchar>(i);
+		for (int j = 0; j < src.cols; j += SAMPLE_STEP) {
+			for (int c = 0; c < 3; c++, k++) {
+				sum += abs(rptr[j * 3 + c] - samples[k]);
 			}
 		}
 	}
+	return k > 0 ? static_cast<double>(sum) / k : 0;
+}
 
+//stores the samples of rows [r0, r1), so the scene check measures change since the mask was made there
+static void takeSamples(const cv::Mat& src, std::vector<uchar>& samples, int r0, int r1) {
 
-
-	// 2nd loop applies the 5x1 filter [1 2 4 2 1]
-	for (int i = 3; i < dst2.rows - 3; i++) {
-
-		//col pointer for updated source
-		cv::Vec3s* nrptrm2 = dst2.ptr<cv::Vec3s>(i - 2);
-		cv::Vec3s* nrptrm1 = dst2.ptr<cv::Vec3s>(i - 1);
-		cv::Vec3s* nrptr = dst2.ptr<cv::Vec3s>(i);
-		cv::Vec3s* nrptrp1 = dst2.ptr<cv::Vec3s>(i + 1);
-		cv::Vec3s* nrptrp2 = dst2.ptr<cv::Vec3s>(i + 2);
-
-		//col pointer for final destination
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
-
-		//for each row in this column
-		for (int j = 3; j < dst2.cols - 3; j++) {
+	int perRow = (src.cols + SAMPLE_STEP - 1) / SAMPLE_STEP * 3;
+	samples.resize(static_cast<size_t>((src.rows + SAMPLE_STEP - 1) / SAMPLE_STEP) * perRow);
+	for (int i = (r0 + SAMPLE_STEP - 1) / SAMPLE_STEP * SAMPLE_STEP; i < r1; i += SAMPLE_STEP) {
+		const uchar* rptr = src.ptr<uchar>(i);
+		uchar* sptr = &samples[static_cast<size_t>(i / SAMPLE_STEP) * perRow];
+		for (int j = 0; j < src.cols; j += SAMPLE_STEP) {
 			for (int c = 0; c < 3; c++) {
-
-				short blurValue = (nrptrm2[j][c] + (2 * nrptrm1[j][c]) + (4 * nrptr[j][c]) +
-					(2 * nrptrp1[j][c]) + nrptrp2[j][c]) / 100;
-				int zone = blurValue / buckets;
-				dptr[j][c] = zone * buckets;
-
-
-				/*
-				if ((j == 100) && (i == 100)) {
-					printf("value here is %d \n", dptr[j][c]);
-				}
-				*/
+				*sptr++ = rptr[j * 3 + c];
 			}
 		}
 	}
+}
 
-	//handling edge cases that can't be properly calculated by filter
-	for (int i = 0; i < src.rows; i++) {
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
+//edge mask of rows [r0, r1) of src. The stripe is a window into src, so its sobel sees the real rows around it.
+static void edgeStripe(cv::Mat& src, cv::Mat& edges, int r0, int r1, int magThreshold) {
 
-		//case for left and right edges
-		if ((i >= 6) && (i <= src.rows - 6)) {
-			for (int c = 0; c < 3; c++) {
-				dptr[0][c] = rptr[0][c];
-				dptr[1][c] = rptr[1][c];
-				dptr[2][c] = rptr[2][c];
-				dptr[src.cols - 3][c] = rptr[src.cols - 3][c];
-				dptr[src.cols - 2][c] = rptr[src.cols - 2][c];
-				dptr[src.cols - 1][c] = rptr[src.cols - 1][c];
+	edgeMask(view(src.rowRange(r0, r1)), view(edges.rowRange(r0, r1)), magThreshold);
+}
 
-			}
-		}
-		//case for top and bottom edges
-		else {
-			for (int j = 0; j < src.cols; j++) {
-				for (int c = 0; c < 3; c++) {
-					dptr[j][c] = rptr[j][c];
-				}
-			}
+//cartoon that keeps its edge mask between frames. The quantized color layer is made every frame,
+//the mask is recomputed one stripe per frame (see CartoonState), and all at once on a scene change.
+int cartoonKeyframed(cv::Mat& src, cv::Mat& dst, int levels, int magThreshold, CartoonState& state, std::vector<cv::Mat>* pyr) {
 
-		}
+	int every = std::max(state.refreshEvery, 1);
+	int stripes = std::min(std::max(state.stripes, 1), std::min(every, std::max(src.rows, 1)));
 
+	//new size or threshold, or the scene moved too far from what the mask was made from
+	bool full = state.edges.size() != src.size() || state.magThreshold != magThreshold;
+	if (!full && state.diffThreshold > 0) {
+		full = sampleDiff(src, state.samples) > state.diffThreshold;
 	}
 
-
-	return 0;
-}
-
-//cartoon filter generates a color quantized frame and checks sobel magnitude for each pixel
-//In my implementation, I zeroed the destination image to black, then only filled in pixels with a magnitude under the threshold
-int cartoon(cv::Mat& src, cv::Mat& dst, int levels, int magThreshold) {
-
-	cv::Mat xsobelsrc;
-	cv::Mat ysobelsrc;
-	cv::Mat magdisp;
-	cv::Mat quantsrc;
-	sobelX3x3(src, xsobelsrc);
-	sobelY3x3(src, ysobelsrc);
-	//generating magnitude and quantize frames of 'levels' levels
-	//magnitude(xsobelsrc, ysobelsrc, magdisp);
-	blurQuantize(src, quantsrc, levels);
-
-	dst = cv::Mat::zeros(src.size(), src.type());
-
-
-	//iterate through all rows. If magnitude has value higher than magThreshold, fill in black on quantized image
-	for (int i = 0; i < dst.rows; i++) {
-
-		//col pointer for x and y sobel
-		cv::Vec3s* xptr = xsobelsrc.ptr<cv::Vec3s>(i);
-		cv::Vec3s* yptr = ysobelsrc.ptr<cv::Vec3s>(i);
-
-		//col pointer for updated source
-		cv::Vec3b* rptr = quantsrc.ptr<cv::Vec3b>(i);
-
-		//col pointer for final destination
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
-
-		//for each row in this column
-		for (int j = 0; j < dst.cols; j++) {
-			int count = 0;
-			for (int c = 0; c < 3; c++){
-				if (sqrt( (xptr[j][c] * xptr[j][c]) + (yptr[j][c] * yptr[j][c]) ) / 3 > magThreshold ) {
-					
-					count++;
-				}
-			}
-			
-			if (count == 0) {
-				dptr[j][0] = rptr[j][0];
-				dptr[j][1] = rptr[j][1];
-				dptr[j][2] = rptr[j][2];
-			}
-
-			/*
-			if ((j == 100) && (i == 100)) {
-				printf("value here is %d \n", dptr[j][c]);
-			}
-			*/
+	if (full) {
+		state.edges.create(src.size(), CV_8U);
+		state.magThreshold = magThreshold;
+		edgeStripe(src, state.edges, 0, src.rows, magThreshold);
+		takeSamples(src, state.samples, 0, src.rows);
+		state.fullRefreshes++;
+		//the whole mask is fresh, so the striped refresh waits and starts over with stripe 0
+		//'every' frames from now
+		state.phase = 0;
+		state.hold = every - 1;
+	}
+	else if (state.hold > 0) {
+		state.hold--;
+	}
+	else {
+		int stripe = static_cast<int>(state.phase % every);
+		if (stripe < stripes) {
+			int r0 = src.rows * stripe / stripes;
+			int r1 = src.rows * (stripe + 1) / stripes;
+			edgeStripe(src, state.edges, r0, r1, magThreshold);
+			takeSamples(src, state.samples, r0, r1);
 		}
+		state.phase++;
 	}
+	state.frames++;
 
-
-	return 0;
+	//quantize straight into dst with the kept edges blacked out
+	dst.create(src.size(), CV_8UC3);
+	std::vector<ImageView> pyrLevels = pyramidInit(dst.size(), pyr);
+	return cartoonMasked(view(src), view(state.edges), view(dst), levels, pyrLevels.data(), static_cast<int>(pyrLevels.size()));
 }
-	
-
 
 //This filter chooses a pixel and gives an adjacent scale x scale area the same values
 int pixelate(cv::Mat &src, cv::Mat &dst, int scale) {
 
-	dst = cv::Mat::zeros(src.size(), src.type());
-
-	int baseRow = 0;
-	int baseCol = 0;
-	//pixel iteration.
-	for (int i = 0; i < src.rows; i++) {
-
-		//determines whether to shift the basePixel value
-		if (i > 0) {
-			if (i % scale == 0) {
-				baseRow = i;
-			}
-		}
-
-		//source row pointer only needs to keep track of 'scale' row
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(baseRow);
-
-		//destination pointer needs to fill in every row
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
-
-		for (int j = 0; j < src.cols; j++) {
-
-			//setting up baseCol based on scale. edge case to avoid divide by 0
-			if (j == 0) {
-				baseCol = 0;
-			}
-			else if (j % scale == 0) {
-				baseCol = j;
-			}
-
-			//each color value is copied to the adjacent 2x2 block of pixels
-			for (int c = 0; c < 3; c++) {
-
-				// color all destination pixels based on source data at [baseRow][baseCol][c]
-				dptr[j][c] = rptr[baseCol][c];
-				
-
-			}
-
-		}
-	}
-
-
-	return 0;
+	dst.create(src.size(), src.type());
+	return pixelate(view(src), view(dst), scale);
 }
 
-
-
-//This filter takes the current frame and the last frame, 
+//This filter takes the current frame and the last frame,
 //then determines (based on sens) whether to show the new frame or the old one.
-//This gives the resulting frame a trail of the last frame, emphasizing movement.
 int movement(cv::Mat &src,cv::Mat &last, cv::Mat &dst, int sens) {
 
-	dst = cv::Mat::zeros(src.size(), src.type());
-
-	for (int i = 0; i < src.rows; i++) {
-
-		//pointer for source
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
-
-		//pointer for last frame
-		cv::Vec3b* lptr = last.ptr<cv::Vec3b>(i);
-
-		//pointer for destination
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
-
-		for (int j = 0; j < src.cols;j++) {
-			//if sum of BGR in src is different enough from lastFrame, set dest to src
-			int newsum = rptr[j][0] + rptr[j][1] + rptr[j][2];
-				int oldsum = lptr[j][0] + lptr[j][1] + lptr[j][2];
-			//only fill color values if source pixel is different enough from last frame
-			if ( abs(newsum - oldsum) > sens) {
-				for (int c = 0; c < 3; c++) {
-					dptr[j][c] = rptr[j][c];
-				}
-			}
-			//otherwise write it from the last frame
-			else {
-				for (int c = 0; c < 3; c++) {
-					dptr[j][c] = lptr[j][c];
-				}
-			}
-
-		}
-	}
-
-	return 0;
+	dst.create(src.size(), src.type());
+	return movement(view(src), view(last), view(dst), sens);
 }
 
-
-
 //this filter will adjust two color channels by a designated amount 'shift'
-int colorshift(cv::Mat &src, cv::Mat &dst, int shift) {
-
-	dst = cv::Mat::zeros(src.size(), src.type());
+int colorshift(cv::Mat &src, cv::Mat &dst, int shift, std::vector<cv::Mat>* pyr) {
 
-	for (int i = 0; i < src.rows; i++) {
-
-		//pointer for source
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
-
-		//pointer for destination
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
-
-		for (int j = 0; j < src.cols; j++) {
-
-			for (int c = 0; c < 3; c++) {
-
-				//blue channels add shift
-				if (c == 0) {
-					//checking if value + shift goes out of bounds in either direction
-					if (rptr[j][c] + shift > 255) {
-						dptr[j][c] = 255;
-					}
-					else if (rptr[j][c] + shift < 0) {
-						dptr[j][c] = 0;
-					}
-					//otherwise add shift to source's value for this color
-					else {
-						dptr[j][c] = rptr[j][c] + shift;
-					}
-				}
-				//green values are shifted in the opposite direction
-				else if (c == 1) {
-					//checking if value + shift goes out of bounds in either direction
-					if (rptr[j][c] - shift > 255) {
-						dptr[j][c] = 255;
-					}
-					else if (rptr[j][c] - shift < 0) {
-						dptr[j][c] = 0;
-					}
-					else {
-						dptr[j][c] = rptr[j][c] - shift;
-					}
-				}
-				//red stays the same in this implementation
-				else {
-					dptr[j][c] = rptr[j][c];
-				}
-			}
-		}
-	}
-
-	return 0;
+	dst.create(src.size(), src.type());
+	std::vector<ImageView> pyrLevels = pyramidInit(dst.size(), pyr);
+	return colorshift(view(src), view(dst), shift, pyrLevels.data(), static_cast<int>(pyrLevels.size()));
 }
 
-
 //attempt to make an hdr image through histogram equalization
-//The algorithm comes from https://cromwell-intl.com/3d/histogram/
-//but the implementation is my own
 int hdrEQ(cv::Mat& src, cv::Mat& dst) {
 
-	//making histogram counting each instance of each 'value'
-	int histo[256] = { 0 };
-	//initializing the cumulative density function array
-	int cdf[256] = { 0 };
+	dst.create(src.size(), src.type());
+	return hdrEQ(view(src), view(dst));
+}
+
+int hdrHistogram(cv::Mat& src, int64_t histo[256]) {
+	return hdrHistogram(view(src), histo);
+}
+
+int hdrApply(cv::Mat& src, cv::Mat& dst, const int64_t histo[256]) {
 
-	dst = cv::Mat::zeros(src.size(), src.type());
+	dst.create(src.size(), src.type());
+	return hdrApply(view(src), view(dst), histo);
+}
 
-	//looping through each pixel to count values for the histogram
-	for (int i = 0; i < src.rows; i++) {
+//runs filter over each region of frame and writes the result back in place
+int filterRegions(cv::Mat& frame, const std::vector<cv::Rect>& regions, const RegionFilter& filter, const cv::Mat& mask) {
 
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
+	if (!mask.empty() && (mask.size() != frame.size() || mask.type() != CV_8UC1)) {
+		return -1;
+	}
 
-		for (int j = 0; j < src.cols; j++) {
-			//increment the histogram element for this pixel's value
-			histo[rptr[j][2]] += 1;
-		}
-		
+	//a mask alone covers the box around its set pixels
+	std::vector<cv::Rect> boxes = regions;
+	if (boxes.empty()) {
+		boxes.push_back(mask.empty() ? cv::Rect(0, 0, frame.cols, frame.rows) : cv::boundingRect(mask));
 	}
 
-	//calculating cumulative density function (sum of all values in histo
-	//lower than any value and including that value)
-	for (int x = 0; x < 256;x++) {
-		//first case, then the rest can be dynamic programming
-		if (x == 0) {
-			cdf[x] = histo[0];
-		}
-		else {
-			cdf[x] = histo[x] + cdf[x - 1];
+	//per-thread buffers reused between calls: the region copies, and the masked / converted results
+	static thread_local std::vector<cv::Mat> sources;
+	static thread_local cv::Mat scratch;
+	static thread_local cv::Mat converted;
+
+	//every region and its apron is copied before any result is written back, so regions that touch
+	//or overlap are each filtered from the original pixels. The region is a window into its copy,
+	//so the kernels still take their apron from the real neighbours.
+	cv::Rect whole(0, 0, frame.cols, frame.rows);
+	std::vector<cv::Rect> rects;
+	std::vector<cv::Mat> windows;
+	if (sources.size() < boxes.size()) {
+		sources.resize(boxes.size());
+	}
+	for (const cv::Rect& box : boxes) {
+		cv::Rect r = box & whole;
+		if (r.empty()) {
+			continue;
 		}
+		cv::Rect outer = cv::Rect(r.x - FILTER_APRON, r.y - FILTER_APRON, r.width + 2 * FILTER_APRON,
+			r.height + 2 * FILTER_APRON) & whole;
+		cv::Mat& copy = sources[rects.size()];
+		frame(outer).copyTo(copy);
+		windows.push_back(copy(cv::Rect(r.x - outer.x, r.y - outer.y, r.width, r.height)));
+		rects.push_back(r);
 	}
 
-	//n is total number of pixels
-	int n = src.rows * src.cols;
-	//now going through each pixel and updating the value based on 
-	//cdf and total num of pixels to equalize
-	for (int i = 0; i < src.rows; i++) {
-
-		cv::Vec3b* rptr = src.ptr<cv::Vec3b>(i);
-		cv::Vec3b* dptr = dst.ptr<cv::Vec3b>(i);
+	for (size_t k = 0; k < rects.size(); k++) {
+		//without a mask the result lands straight in frame (dst is a separate header from target,
+		//so a filter that reallocates it, like the 16-bit sobels, leaves frame alone)
+		cv::Mat target = frame(rects[k]);
+		cv::Mat direct = target;
+		cv::Mat& out = mask.empty() ? direct : scratch;
+		if (filter(windows[k], out, rects[k]) != 0) {
+			return -1;
+		}
 
-		for (int j = 0; j < src.cols; j++) {
+		//filters with a 16-bit or gray result can't write a BGR frame, they are converted here
+		const cv::Mat* result = &out;
+		if (out.type() != frame.type()) {
+			if (out.depth() != CV_8U) {
+				cv::convertScaleAbs(out, converted);
+			}
+			else {
+				converted = out;
+			}
+			if (converted.channels() == 1) {
+				cv::cvtColor(converted, converted, cv::COLOR_GRAY2BGR);
+			}
+			result = &converted;
+		}
 
-			//calculating the equalized value based on our histogram and cdf results
-			dptr[j][2] = floor(255 * ( cdf[rptr[j][2]] - cdf[0]) / (n - cdf[0]) );
-			//copying the hue/sat from source too
-			dptr[j][0] = rptr[j][0];
-			dptr[j][1] = rptr[j][1];
-			
+		if (!mask.empty()) {
+			result->copyTo(target, mask(rects[k]));
+		}
+		else if (result->data != target.data) {
+			result->copyTo(target);
 		}
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -1,16 +1,73 @@
 #pragma once
 //James Marcel
 //filter library header
+//cv::Mat versions of the kernels in filterCore.h (which take plain image views instead).
+//dst is allocated with create(), so a dst that already has the right size and type (for
+//example a window into a bigger canvas) is written in place
 
-int gradX(cv::Mat &src, cv::Mat &dst);
+#include <functional>
+#include "filterCore.h"
+
+//gradX and the sobels make CV_16SC3, or with disp a display-ready CV_8UC3 of the absolute values
+//(the same as convertScaleAbs of the 16-bit result, without writing the 16-bit frame)
+int gradX(cv::Mat &src, cv::Mat &dst, bool disp = false);
 int grayScale(cv::Mat &src, cv::Mat &dst);
-int blur5x5(cv::Mat &src, cv::Mat &dst);
-int sobelX3x3(cv::Mat &src, cv::Mat &dst);
-int sobelY3x3(cv::Mat &src, cv::Mat &dst);
+//blur5x5, blurQuantize, cartoon and colorshift can also fill pyr with half, quarter, ... size
+//versions of dst in the same pass (see pyramidInit in filter.cpp for the level count)
+int blur5x5(cv::Mat &src, cv::Mat &dst, std::vector<cv::Mat> *pyr = nullptr);
+int sobelX3x3(cv::Mat &src, cv::Mat &dst, bool disp = false);
+int sobelY3x3(cv::Mat &src, cv::Mat &dst, bool disp = false);
+//CV_16SC3 sobel / gradX result to CV_8UC3 absolute values (convertScaleAbs)
+int absSaturate(cv::Mat &src, cv::Mat &dst);
 int magnitude(cv::Mat &sx, cv::Mat &sy, cv::Mat& dst);
-int blurQuantize(cv::Mat &src, cv::Mat &dst, int levels);
-int cartoon(cv::Mat &src, cv::Mat &dst, int levels, int magThreshold);
+int blurQuantize(cv::Mat &src, cv::Mat &dst, int levels, std::vector<cv::Mat> *pyr = nullptr);
+//blurQuantize on a frame that blur5x5 already made
+int quantize(cv::Mat &blurred, cv::Mat &dst, int levels);
+int cartoon(cv::Mat &src, cv::Mat &dst, int levels, int magThreshold, std::vector<cv::Mat> *pyr = nullptr);
 int pixelate(cv::Mat& src, cv::Mat& dst, int scale);
 int movement(cv::Mat& src, cv::Mat &last, cv::Mat& dst, int sens);
-int colorshift(cv::Mat& src, cv::Mat& dst, int shift);
-int hdrEQ(cv::Mat& src, cv::Mat& dst);
\ No newline at end of file
+int colorshift(cv::Mat& src, cv::Mat& dst, int shift, std::vector<cv::Mat> *pyr = nullptr);
+int hdrEQ(cv::Mat& src, cv::Mat& dst);
+//hdrEQ in two passes, for an image processed in pieces: hdrHistogram adds each piece to histo
+//(zeroed first), then hdrApply equalizes each piece with the histogram of the whole image
+int hdrHistogram(cv::Mat& src, int64_t histo[256]);
+int hdrApply(cv::Mat& src, cv::Mat& dst, const int64_t histo[256]);
+
+//versions that take their intermediates from a FrameCache (see frameCache.h), so filters run on
+//the same frame share one sobel / quantize pass
+class FrameCache;
+int cartoon(FrameCache &cache, cv::Mat &dst, int levels, int magThreshold, std::vector<cv::Mat> *pyr = nullptr);
+int magnitude(FrameCache &cache, cv::Mat &dst);
+
+//cartoon with the edge mask kept between frames: the color layer is redone every frame, but the
+//edge mask is refreshed once every refreshEvery frames, one stripe of rows per frame over 'stripes'
+//frames so no frame pays for the whole mask. When the mean change of a sparse set of sampled pixels
+//goes over diffThreshold (0-255, 0 = never) the whole mask is redone at once, and the stripes start
+//over refreshEvery frames later.
+struct CartoonState {
+	int refreshEvery = 8;
+	int stripes = 8;
+	double diffThreshold = 12;
+
+	cv::Mat edges;
+	std::vector<uchar> samples;
+	int magThreshold = -1;
+	int64_t phase = 0;
+	int hold = 0;
+	int64_t frames = 0;
+	int64_t fullRefreshes = 0;
+};
+int cartoonKeyframed(cv::Mat &src, cv::Mat &dst, int levels, int magThreshold, CartoonState &state, std::vector<cv::Mat> *pyr = nullptr);
+
+//filters only some regions of frame, in place: only each region plus the kernel apron
+//(FILTER_APRON) is read, and the result is written back into the region, leaving the rest of frame
+//untouched. Regions are clipped to the frame. All of them are filtered from the frame as it was
+//passed in, so touching regions don't see each other's results; where regions overlap the later
+//one's result is kept. With a mask (CV_8UC1, frame sized) only the pixels where it is non-zero
+//change; with a mask and no regions, the box around the mask is filtered. Filters whose result
+//isn't a BGR frame (gray, 16-bit sobels) are converted for display on the way back.
+//filter is called as filter(src, dst, region), src being the region's pixels (with their real
+//neighbours as apron) and region where they are in frame, for filters that need the same part of
+//another frame, e.g. [](cv::Mat &s, cv::Mat &d, cv::Rect) { return blur5x5(s, d); }
+typedef std::function<int(cv::Mat &src, cv::Mat &dst, cv::Rect region)> RegionFilter;
+int filterRegions(cv::Mat &frame, const std::vector<cv::Rect> &regions, const RegionFilter &filter, const cv::Mat &mask = cv::Mat());
@@ -0,0 +1,921 @@
+//James Marcel
+//filter library core - the kernels on ImageViews, no OpenCV
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "filterCore.h"
+#include "paddedFrame.h"
+
+typedef uint8_t uchar;
+
+//with FILTER_DISPATCH the kernels below are cloned for baseline x86-64 (SSE2), AVX2 and AVX-512.
+//The loader checks cpuid once at startup and binds each kernel to the best clone for this cpu.
+#if defined(FILTER_DISPATCH) && defined(__x86_64__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define FILTER_KERNEL __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#define FILTER_CLONED 1
+#endif
+#endif
+#ifndef FILTER_KERNEL
+#define FILTER_KERNEL
+#endif
+
+//reports which kernel variant the dispatcher selected on this machine, "native" if the kernels
+//weren't cloned (no FILTER_DISPATCH, or a compiler without target_clones)
+const char* filterIsa() {
+#ifdef FILTER_CLONED
+	if (__builtin_cpu_supports("x86-64-v4")) {
+		return "avx512";
+	}
+	if (__builtin_cpu_supports("x86-64-v3")) {
+		return "avx2";
+	}
+	return "sse2";
+#else
+	return "native";
+#endif
+}
+
+int formatBytes(ImageFormat format) {
+	return format == IMAGE_GRAY8 ? 1 : format == IMAGE_BGR8 ? 3 : 6;
+}
+
+ImageView ImageView::window(int x, int y, int w, int h) const {
+
+	//a window that isn't inside the view comes back empty, which every kernel refuses
+	if (data == nullptr || x < 0 || y < 0 || w <= 0 || h <= 0 || w > width - x || h > height - y) {
+		return ImageView();
+	}
+	ImageView v(data + static_cast<std::ptrdiff_t>(y) * stride + x * formatBytes(format), w, h, stride, format);
+	v.haloTop = haloTop + y;
+	v.haloLeft = haloLeft + x;
+	v.haloBottom = haloBottom + height - y - h;
+	v.haloRight = haloRight + width - x - w;
+	return v;
+}
+
+
+//every kernel reads at most 2 pixels past an edge (the 5x5 blur), so one apron size fits all
+static const int APRON = FILTER_APRON;
+
+//how the apron is filled, see setFilterBorder
+static int borderMode = PAD_REPLICATE;
+
+void setFilterBorder(int mode) {
+	borderMode = (mode == FILTER_BORDER_REFLECT) ? PAD_REFLECT : PAD_REPLICATE;
+}
+
+//per-thread scratch frames, reused from frame to frame so the kernels don't allocate
+static thread_local PaddedFrame<uchar> padSrc;
+static thread_local PaddedFrame<short> padTmp;
+
+//copies a BGR8 src into pad and fills the apron once. If src is a window into a bigger image,
+//the real neighbouring pixels (its halo) are used for the apron, so filtering a strip or region
+//of an image gives the same result as filtering the whole image there. -1 if pad can't be allocated.
+static int padFrame(const ImageView& src, PaddedFrame<uchar>& pad) {
+
+	if (pad.create(src.width, src.height, 3, APRON) != 0) {
+		return -1;
+	}
+	return pad.fill(src.data, src.stride, src.haloTop, src.haloBottom, src.haloLeft, src.haloRight, borderMode);
+}
+
+//true if v is there and is w x h of format f
+static bool fits(const ImageView& v, int w, int h, ImageFormat f) {
+	return v.data != nullptr && v.width == w && v.height == h && v.format == f;
+}
+
+static bool isBGR8(const ImageView& v) {
+	return v.data != nullptr && v.format == IMAGE_BGR8;
+}
+
+
+//display output of the signed kernels: |v| saturated to 0-255, what convertScaleAbs would make of
+//the 16-bit result, done in the kernel's final store so the 16-bit frame is never written
+static inline uchar saturateAbs(int v) {
+	v = v < 0 ? -v : v;
+	return static_cast<uchar>(v > 255 ? 255 : v);
+}
+
+//gradX of element k of a row, given the rows above and below
+static inline int gradXAt(const uchar* rptrm1, const uchar* rptr, const uchar* rptrp1, int k) {
+	//summing filtered surrounding values
+	return ((-1 * rptrm1[k - 3]) + rptrp1[k + 3] +
+		(-2 * rptr[k - 3]) + (2 * rptr[k + 3]) +
+		(-1 * rptrp1[k - 3]) + rptrp1[k + 3]) / 4;
+}
+
+//apply a 3x3 filter - datatype will be BGR16S (BGR8 absolute values for a BGR8 dst)
+//[-1 0 1]
+//[-2 0 2]
+//[-1 0 1]
+FILTER_KERNEL int gradX(const ImageView &src, const ImageView &dst) {
+
+	if (!isBGR8(src) || (!fits(dst, src.width, src.height, IMAGE_BGR16S) && !fits(dst, src.width, src.height, IMAGE_BGR8))) {
+		return -1;
+	}
+	bool disp = dst.format == IMAGE_BGR8;
+
+	//padded copy of src so the filter also covers the edge pixels
+	if (padFrame(src, padSrc) != 0) {
+		return -1;
+	}
+
+	//loop over src and apply a 3x3 filter
+	//rows are flat arrays of b,g,r values, so the pixel to the left is 3 elements back
+	int n = src.width * 3;
+	for (int i = 0; i < src.height; i++) {
+
+		//src needs ptrs to rows above and below
+		const uchar* rptrm1 = padSrc.row(i - 1);
+		const uchar* rptr = padSrc.row(i);
+		const uchar* rptrp1 = padSrc.row(i + 1);
+
+		if (disp) {
+			uchar* dptr = dst.row<uchar>(i);
+			for (int k = 0; k < n; k++) {
+				dptr[k] = saturateAbs(gradXAt(rptrm1, rptr, rptrp1, k));
+			}
+		}
+		else {
+			short* dptr = dst.row<short>(i);
+			for (int k = 0; k < n; k++) {
+				dptr[k] = gradXAt(rptrm1, rptr, rptrp1, k);
+			}
+		}
+	}
+
+	//return
+	return 0;
+}
+
+//grayScale averages the RGB values of each pixel and sets result in destination array as uchar
+FILTER_KERNEL int grayScale(const ImageView &src, const ImageView &dst) {
+
+	if (!isBGR8(src) || !fits(dst, src.width, src.height, IMAGE_GRAY8)) {
+		return -1;
+	}
+
+	//loop over source and avg the 3 color values to get a grayscale value
+	for (int i = 0; i < src.height; i++) {
+
+		//src row pointer
+		const uchar* rptr = src.row<uchar>(i);
+
+		//dst is one uchar per pixel
+		uchar* dptr = dst.row<uchar>(i);
+
+		//going through each column of
+		for (int j = 0; j < src.width; j++) {
+
+			//averaging each b,g,r triple into a single value to store in the dst
+			dptr[j] = (rptr[j * 3] + rptr[j * 3 + 1] + rptr[j * 3 + 2]) / 3;
+
+		}
+
+	}
+
+
+	//return
+	return 0;
+}
+
+
+
+//averages 2x2 blocks of two finished rows into one row of the next smaller pyramid level
+static void downRow(const uchar* r0, const uchar* r1, uchar* dptr, int cols) {
+
+	for (int j = 0; j < cols; j++) {
+		for (int c = 0; c < 3; c++) {
+			dptr[j * 3 + c] = (r0[6 * j + c] + r0[6 * j + 3 + c] + r1[6 * j + c] + r1[6 * j + 3 + c] + 2) / 4;
+		}
+	}
+}
+
+//true if pyr is missing or its levels are the halving chain of a w x h BGR8 frame
+static bool pyramidFits(int w, int h, const ImageView* pyr, int pyrCount) {
+
+	for (int k = 0; pyr != nullptr && k < pyrCount; k++) {
+		w /= 2;
+		h /= 2;
+		if (!fits(pyr[k], w, h, IMAGE_BGR8)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//called as soon as row i of dst is final. Every odd row completes a pair, which gives one row
+//of the next level, which may in turn complete a pair there - so each level is built from rows
+//that were written moments ago and are still in cache, instead of a separate resize pass.
+static void pyramidRow(const ImageView& dst, int i, const ImageView* pyr, int pyrCount) {
+
+	if (pyr == nullptr) {
+		return;
+	}
+	const ImageView* prev = &dst;
+	int row = i;
+	for (int k = 0; k < pyrCount; k++) {
+		const ImageView& level = pyr[k];
+		if (row % 2 == 0 || row / 2 >= level.height) {
+			return;
+		}
+		downRow(prev->row<uchar>(row - 1), prev->row<uchar>(row), level.row<uchar>(row / 2), level.width);
+		prev = &level;
+		row = row / 2;
+	}
+}
+
+
+//horizontal [1 2 4 2 1] pass of the 5x5 blur over every row of the padded source, including
+//the 2 apron rows above and below that the vertical pass needs. -1 if tmp can't be allocated.
+FILTER_KERNEL static int blurRows(const PaddedFrame<uchar>& in, PaddedFrame<short>& tmp) {
+
+	if (tmp.create(in.cols(), in.rows(), 3, APRON) != 0) {
+		return -1;
+	}
+	int n = in.cols() * 3;
+	for (int i = -2; i < in.rows() + 2; i++) {
+
+		const uchar* rptr = in.row(i);
+		short* dptr2 = tmp.row(i);
+
+		for (int k = 0; k < n; k++) {
+			dptr2[k] = rptr[k - 6] + (2 * rptr[k - 3]) + (4 * rptr[k]) + (2 * rptr[k + 3]) + rptr[k + 6];
+		}
+	}
+	return 0;
+}
+
+//blur filter is separable 1x5 and 5x1 filters ([1 2 4 2 1]) to approximate a 5x5 gaussian blur in the destination
+FILTER_KERNEL int blur5x5(const ImageView &src, const ImageView &dst, const ImageView *pyr, int pyrCount) {
+
+	if (!isBGR8(src) || !fits(dst, src.width, src.height, IMAGE_BGR8) || !pyramidFits(src.width, src.height, pyr, pyrCount)) {
+		return -1;
+	}
+
+	//padded source (apron filled once) and the first convolution
+	if (padFrame(src, padSrc) != 0 || blurRows(padSrc, padTmp) != 0) {
+		return -1;
+	}
+
+	// 2nd loop applies the 5x1 filter [1 2 4 2 1] and writes to final result destination.
+	//The apron gives every row 2 rows above and below, so edges need no special case and each
+	//row is final (and can feed the pyramid) as soon as it is written
+	int n = src.width * 3;
+	for (int i = 0; i < src.height; i++) {
+
+		//row pointers for the first convolution
+		const short* nrptrm2 = padTmp.row(i - 2);
+		const short* nrptrm1 = padTmp.row(i - 1);
+		const short* nrptr = padTmp.row(i);
+		const short* nrptrp1 = padTmp.row(i + 1);
+		const short* nrptrp2 = padTmp.row(i + 2);
+
+		//row pointer for final destination
+		uchar* dptr = dst.row<uchar>(i);
+
+		for (int k = 0; k < n; k++) {
+			//writing result to destination array (result divided by sum of gaussian array (100))
+			dptr[k] = (nrptrm2[k] + (2 * nrptrm1[k]) + (4 * nrptr[k]) + (2 * nrptrp1[k]) + nrptrp2[k]) / 100;
+		}
+
+		pyramidRow(dst, i, pyr, pyrCount);
+	}
+
+	return 0;
+}
+
+
+//sobel X / Y of element k of a row, given the rows above and below
+static inline int sobelXAt(const uchar* rptrm1, const uchar* rptr, const uchar* rptrp1, int k) {
+	return (rptrm1[k + 3] - rptrm1[k - 3]) + 2 * (rptr[k + 3] - rptr[k - 3]) + (rptrp1[k + 3] - rptrp1[k - 3]);
+}
+
+static inline int sobelYAt(const uchar* rptrm1, const uchar* rptrp1, int k) {
+	return (rptrp1[k - 3] + 2 * rptrp1[k] + rptrp1[k + 3]) - (rptrm1[k - 3] + 2 * rptrm1[k] + rptrm1[k + 3]);
+}
+
+//cartoon's edge test on pixel j of a padded row: sobel magnitude / 3 over magThreshold in any channel
+static inline bool edgeAt(const uchar* rptrm1, const uchar* rptr, const uchar* rptrp1, int j, int magThreshold) {
+
+	bool edge = false;
+	for (int c = 0; c < 3; c++) {
+		int x = sobelXAt(rptrm1, rptr, rptrp1, j * 3 + c);
+		int y = sobelYAt(rptrm1, rptrp1, j * 3 + c);
+		if (sqrt((x * x) + (y * y)) / 3 > magThreshold) {
+			edge = true;
+		}
+	}
+	return edge;
+}
+
+//X sobel on an already padded source: [-1 0 1] horizontal and [1 2 1] vertical in one pass
+FILTER_KERNEL static void sobelXPadded(const PaddedFrame<uchar>& in, const ImageView& dst) {
+
+	bool disp = dst.format == IMAGE_BGR8;
+	int n = in.cols() * 3;
+	for (int i = 0; i < in.rows(); i++) {
+
+		const uchar* rptrm1 = in.row(i - 1);
+		const uchar* rptr = in.row(i);
+		const uchar* rptrp1 = in.row(i + 1);
+
+		if (disp) {
+			uchar* dptr = dst.row<uchar>(i);
+			for (int k = 0; k < n; k++) {
+				dptr[k] = saturateAbs(sobelXAt(rptrm1, rptr, rptrp1, k));
+			}
+		}
+		else {
+			short* dptr = dst.row<short>(i);
+			for (int k = 0; k < n; k++) {
+				dptr[k] = sobelXAt(rptrm1, rptr, rptrp1, k);
+			}
+		}
+	}
+}
+
+//Y sobel on an already padded source: [1 2 1] horizontal and [-1 0 1] vertical in one pass
+FILTER_KERNEL static void sobelYPadded(const PaddedFrame<uchar>& in, const ImageView& dst) {
+
+	bool disp = dst.format == IMAGE_BGR8;
+	int n = in.cols() * 3;
+	for (int i = 0; i < in.rows(); i++) {
+
+		const uchar* rptrm1 = in.row(i - 1);
+		const uchar* rptrp1 = in.row(i + 1);
+
+		if (disp) {
+			uchar* dptr = dst.row<uchar>(i);
+			for (int k = 0; k < n; k++) {
+				dptr[k] = saturateAbs(sobelYAt(rptrm1, rptrp1, k));
+			}
+		}
+		else {
+			short* dptr = dst.row<short>(i);
+			for (int k = 0; k < n; k++) {
+				dptr[k] = sobelYAt(rptrm1, rptrp1, k);
+			}
+		}
+	}
+}
+
+
+//implements X sobel 3x3 filter convolving [-1 0 1]horizontal and [1 2 1] vertical (positive right)
+int sobelX3x3(const ImageView &src, const ImageView &dst) {
+
+	if (!isBGR8(src) || (!fits(dst, src.width, src.height, IMAGE_BGR16S) && !fits(dst, src.width, src.height, IMAGE_BGR8))) {
+		return -1;
+	}
+	if (padFrame(src, padSrc) != 0) {
+		return -1;
+	}
+	sobelXPadded(padSrc, dst);
+	return 0;
+}
+
+
+//implements Y sobel 3x3 filter convolving [-1 0 1]vertical and [1 2 1] horizontal
+//works off same logic as X3x3 but positive down
+int sobelY3x3(const ImageView &src, const ImageView &dst) {
+
+	if (!isBGR8(src) || (!fits(dst, src.width, src.height, IMAGE_BGR16S) && !fits(dst, src.width, src.height, IMAGE_BGR8))) {
+		return -1;
+	}
+	if (padFrame(src, padSrc) != 0) {
+		return -1;
+	}
+	sobelYPadded(padSrc, dst);
+	return 0;
+}
+
+//display version of a signed kernel result that was already computed: |v| saturated to 0-255,
+//what the kernels write to an IMAGE_BGR8 dst (and what convertScaleAbs makes of it)
+FILTER_KERNEL int absSaturate(const ImageView &src, const ImageView &dst) {
+
+	if (src.data == nullptr || src.format != IMAGE_BGR16S || !fits(dst, src.width, src.height, IMAGE_BGR8)) {
+		return -1;
+	}
+
+	int n = src.width * 3;
+	for (int i = 0; i < src.height; i++) {
+		const short* rptr = src.row<short>(i);
+		uchar* dptr = dst.row<uchar>(i);
+		for (int k = 0; k < n; k++) {
+			dptr[k] = saturateAbs(rptr[k]);
+		}
+	}
+
+	return 0;
+}
+
+//combines sobelx and sobely arrays to determine gradient magnitude of each pixel.
+//NOTE: I divided each result by 3 to give a less noisy image. Could be due to my webcam.
+FILTER_KERNEL int magnitude(const ImageView &sx, const ImageView &sy, const ImageView &dst) {
+
+	if (sx.data == nullptr || sx.format != IMAGE_BGR16S || !fits(sy, sx.width, sx.height, IMAGE_BGR16S) ||
+		!fits(dst, sx.width, sx.height, IMAGE_BGR8)) {
+		return -1;
+	}
+
+	int n = sx.width * 3;
+	for (int i = 0; i < sx.height; i++) {
+
+		//row pointers for sx and sy
+		const short* xptr = sx.row<short>(i);
+		const short* yptr = sy.row<short>(i);
+
+		//row pointer for destination
+		uchar* dptr = dst.row<uchar>(i);
+
+		for (int k = 0; k < n; k++) {
+
+			//NOTE: Initially the formula sqrt(sx*sx + sy*sy) was too sensitive on my camera, so i divided results by 3 for a more practical image
+			dptr[k] = sqrt((xptr[k] * xptr[k]) + (yptr[k] * yptr[k]))/3;
+
+		}
+
+	}
+
+	return 0;
+}
+
+//one of 'levels' values for a blurred pixel, buckets being 255 / levels
+static inline uchar quantizeValue(short blurValue, float buckets) {
+	int zone = blurValue / buckets;
+	return zone * buckets;
+}
+
+//vertical pass of the blur for row i, quantized to 'levels' values, written to dptr.
+//padTmp must hold blurRows of the padded source.
+static inline void quantizeRow(int i, int n, float buckets, uchar* dptr) {
+
+	//row pointers for the first convolution
+	const short* nrptrm2 = padTmp.row(i - 2);
+	const short* nrptrm1 = padTmp.row(i - 1);
+	const short* nrptr = padTmp.row(i);
+	const short* nrptrp1 = padTmp.row(i + 1);
+	const short* nrptrp2 = padTmp.row(i + 2);
+
+	for (int k = 0; k < n; k++) {
+		short blurValue = (nrptrm2[k] + (2 * nrptrm1[k]) + (4 * nrptr[k]) + (2 * nrptrp1[k]) + nrptrp2[k]) / 100;
+		dptr[k] = quantizeValue(blurValue, buckets);
+	}
+}
+
+//quantizes an image that was already blurred (blur5x5). The blur's rows are exactly the blurValue
+//quantizeRow computes, so this gives the same result as blurQuantize of the original.
+FILTER_KERNEL int quantize(const ImageView &blurred, const ImageView &dst, int levels) {
+
+	if (!isBGR8(blurred) || !fits(dst, blurred.width, blurred.height, IMAGE_BGR8) || levels <= 0) {
+		return -1;
+	}
+
+	float buckets = static_cast<float>(255) / levels;
+
+	int n = blurred.width * 3;
+	for (int i = 0; i < blurred.height; i++) {
+		const uchar* rptr = blurred.row<uchar>(i);
+		uchar* dptr = dst.row<uchar>(i);
+		for (int k = 0; k < n; k++) {
+			dptr[k] = quantizeValue(rptr[k], buckets);
+		}
+	}
+
+	return 0;
+}
+
+//blurs the image but chooses one of 'levels' pixel values to quantize color
+//Uses the same framework as gaussian blur, but added the bucket steps into the second full frame iteration to save
+//cpu from computing another full iteration
+FILTER_KERNEL int blurQuantize(const ImageView &src, const ImageView &dst, int levels, const ImageView *pyr, int pyrCount) {
+
+	if (!isBGR8(src) || !fits(dst, src.width, src.height, IMAGE_BGR8) || levels <= 0 ||
+		!pyramidFits(src.width, src.height, pyr, pyrCount)) {
+		return -1;
+	}
+
+	float buckets = static_cast<float>(255) / levels;
+
+	//padded source and the first convolution
+	if (padFrame(src, padSrc) != 0 || blurRows(padSrc, padTmp) != 0) {
+		return -1;
+	}
+
+	// 2nd loop applies the 5x1 filter [1 2 4 2 1] and quantizes
+	int n = src.width * 3;
+	for (int i = 0; i < src.height; i++) {
+		quantizeRow(i, n, buckets, dst.row<uchar>(i));
+		pyramidRow(dst, i, pyr, pyrCount);
+	}
+
+	return 0;
+}
+
+//cartoon filter generates a color quantized frame and checks sobel magnitude for each pixel
+//In my implementation, pixels with a magnitude over the threshold are black, the rest are filled in from the quantized frame.
+//Everything comes from one padded copy of the source, a row at a time, so there are no sobel or
+//quantize frames in between.
+FILTER_KERNEL int cartoon(const ImageView &src, const ImageView &dst, int levels, int magThreshold, const ImageView *pyr, int pyrCount) {
+
+	if (!isBGR8(src) || !fits(dst, src.width, src.height, IMAGE_BGR8) || levels <= 0 ||
+		!pyramidFits(src.width, src.height, pyr, pyrCount)) {
+		return -1;
+	}
+
+	float buckets = static_cast<float>(255) / levels;
+
+	if (padFrame(src, padSrc) != 0 || blurRows(padSrc, padTmp) != 0) {
+		return -1;
+	}
+
+	int n = src.width * 3;
+	for (int i = 0; i < src.height; i++) {
+
+		//generating the quantized row of 'levels' levels, then black where the edges are
+		uchar* dptr = dst.row<uchar>(i);
+		quantizeRow(i, n, buckets, dptr);
+
+		const uchar* rptrm1 = padSrc.row(i - 1);
+		const uchar* rptr = padSrc.row(i);
+		const uchar* rptrp1 = padSrc.row(i + 1);
+		for (int j = 0; j < src.width; j++) {
+			if (edgeAt(rptrm1, rptr, rptrp1, j, magThreshold)) {
+				dptr[j * 3] = 0;
+				dptr[j * 3 + 1] = 0;
+				dptr[j * 3 + 2] = 0;
+			}
+		}
+
+		pyramidRow(dst, i, pyr, pyrCount);
+	}
+
+	return 0;
+}
+
+//blacks out the quantized pixels whose sobel magnitude is over magThreshold
+FILTER_KERNEL int cartoonCombine(const ImageView &sx, const ImageView &sy, const ImageView &quant, const ImageView &dst,
+	int magThreshold, const ImageView *pyr, int pyrCount) {
+
+	if (!isBGR8(quant) || !fits(sx, quant.width, quant.height, IMAGE_BGR16S) || !fits(sy, quant.width, quant.height, IMAGE_BGR16S) ||
+		!fits(dst, quant.width, quant.height, IMAGE_BGR8) || !pyramidFits(quant.width, quant.height, pyr, pyrCount)) {
+		return -1;
+	}
+
+	//iterate through all rows. If magnitude has value higher than magThreshold, fill in black on quantized image
+	for (int i = 0; i < dst.height; i++) {
+
+		//row pointers for x and y sobel
+		const short* xptr = sx.row<short>(i);
+		const short* yptr = sy.row<short>(i);
+
+		//row pointer for the quantized source
+		const uchar* rptr = quant.row<uchar>(i);
+
+		//row pointer for final destination
+		uchar* dptr = dst.row<uchar>(i);
+
+		//for each pixel in this row
+		for (int j = 0; j < dst.width; j++) {
+			int count = 0;
+			for (int c = 0; c < 3; c++){
+				int k = j * 3 + c;
+				if (sqrt( (xptr[k] * xptr[k]) + (yptr[k] * yptr[k]) ) / 3 > magThreshold ) {
+
+					count++;
+				}
+			}
+
+			for (int c = 0; c < 3; c++) {
+				dptr[j * 3 + c] = (count == 0) ? rptr[j * 3 + c] : 0;
+			}
+		}
+
+		pyramidRow(dst, i, pyr, pyrCount);
+	}
+
+	return 0;
+}
+
+//255 where cartoon would black a pixel out, 0 elsewhere
+FILTER_KERNEL int edgeMask(const ImageView &src, const ImageView &mask, int magThreshold) {
+
+	if (!isBGR8(src) || !fits(mask, src.width, src.height, IMAGE_GRAY8)) {
+		return -1;
+	}
+
+	if (padFrame(src, padSrc) != 0) {
+		return -1;
+	}
+	for (int i = 0; i < src.height; i++) {
+
+		const uchar* rptrm1 = padSrc.row(i - 1);
+		const uchar* rptr = padSrc.row(i);
+		const uchar* rptrp1 = padSrc.row(i + 1);
+		uchar* mptr = mask.row<uchar>(i);
+
+		for (int j = 0; j < src.width; j++) {
+			mptr[j] = edgeAt(rptrm1, rptr, rptrp1, j, magThreshold) ? 255 : 0;
+		}
+	}
+
+	return 0;
+}
+
+//quantized src, black where mask is set
+FILTER_KERNEL int cartoonMasked(const ImageView &src, const ImageView &mask, const ImageView &dst, int levels,
+	const ImageView *pyr, int pyrCount) {
+
+	if (!isBGR8(src) || !fits(mask, src.width, src.height, IMAGE_GRAY8) || !fits(dst, src.width, src.height, IMAGE_BGR8) ||
+		levels <= 0 || !pyramidFits(src.width, src.height, pyr, pyrCount)) {
+		return -1;
+	}
+
+	float buckets = static_cast<float>(255) / levels;
+
+	if (padFrame(src, padSrc) != 0 || blurRows(padSrc, padTmp) != 0) {
+		return -1;
+	}
+
+	int n = src.width * 3;
+	for (int i = 0; i < src.height; i++) {
+
+		uchar* dptr = dst.row<uchar>(i);
+		quantizeRow(i, n, buckets, dptr);
+
+		const uchar* mptr = mask.row<uchar>(i);
+		for (int j = 0; j < src.width; j++) {
+			if (mptr[j]) {
+				dptr[j * 3] = 0;
+				dptr[j * 3 + 1] = 0;
+				dptr[j * 3 + 2] = 0;
+			}
+		}
+
+		pyramidRow(dst, i, pyr, pyrCount);
+	}
+
+	return 0;
+}
+
+
+
+//This filter chooses a pixel and gives an adjacent scale x scale area the same values
+//(in place works: every pixel only reads the block corner, which is written with its own value)
+FILTER_KERNEL int pixelate(const ImageView &src, const ImageView &dst, int scale) {
+
+	if (!isBGR8(src) || !fits(dst, src.width, src.height, IMAGE_BGR8) || scale <= 0) {
+		return -1;
+	}
+
+	int baseRow = 0;
+	int baseCol = 0;
+	//pixel iteration.
+	for (int i = 0; i < src.height; i++) {
+
+		//determines whether to shift the basePixel value
+		if (i > 0) {
+			if (i % scale == 0) {
+				baseRow = i;
+			}
+		}
+
+		//source row pointer only needs to keep track of 'scale' row
+		const uchar* rptr = src.row<uchar>(baseRow);
+
+		//destination pointer needs to fill in every row
+		uchar* dptr = dst.row<uchar>(i);
+
+		for (int j = 0; j < src.width; j++) {
+
+			//setting up baseCol based on scale. edge case to avoid divide by 0
+			if (j == 0) {
+				baseCol = 0;
+			}
+			else if (j % scale == 0) {
+				baseCol = j;
+			}
+
+			//each color value is copied to the adjacent 2x2 block of pixels
+			for (int c = 0; c < 3; c++) {
+
+				// color all destination pixels based on source data at [baseRow][baseCol][c]
+				dptr[j * 3 + c] = rptr[baseCol * 3 + c];
+
+
+			}
+
+		}
+	}
+
+
+	return 0;
+}
+
+
+
+//This filter takes the current frame and the last frame,
+//then determines (based on sens) whether to show the new frame or the old one.
+//This gives the resulting frame a trail of the last frame, emphasizing movement.
+FILTER_KERNEL int movement(const ImageView &src, const ImageView &last, const ImageView &dst, int sens) {
+
+	if (!isBGR8(src) || !fits(last, src.width, src.height, IMAGE_BGR8) || !fits(dst, src.width, src.height, IMAGE_BGR8)) {
+		return -1;
+	}
+
+	for (int i = 0; i < src.height; i++) {
+
+		//pointer for source
+		const uchar* rptr = src.row<uchar>(i);
+
+		//pointer for last frame
+		const uchar* lptr = last.row<uchar>(i);
+
+		//pointer for destination
+		uchar* dptr = dst.row<uchar>(i);
+
+		for (int j = 0; j < src.width;j++) {
+			//if sum of BGR in src is different enough from lastFrame, set dest to src
+			int newsum = rptr[j * 3] + rptr[j * 3 + 1] + rptr[j * 3 + 2];
+				int oldsum = lptr[j * 3] + lptr[j * 3 + 1] + lptr[j * 3 + 2];
+			//only fill color values if source pixel is different enough from last frame
+			if ( abs(newsum - oldsum) > sens) {
+				for (int c = 0; c < 3; c++) {
+					dptr[j * 3 + c] = rptr[j * 3 + c];
+				}
+			}
+			//otherwise write it from the last frame
+			else {
+				for (int c = 0; c < 3; c++) {
+					dptr[j * 3 + c] = lptr[j * 3 + c];
+				}
+			}
+
+		}
+	}
+
+	return 0;
+}
+
+
+
+//this filter will adjust two color channels by a designated amount 'shift'
+FILTER_KERNEL int colorshift(const ImageView &src, const ImageView &dst, int shift, const ImageView *pyr, int pyrCount) {
+
+	if (!isBGR8(src) || !fits(dst, src.width, src.height, IMAGE_BGR8) || !pyramidFits(src.width, src.height, pyr, pyrCount)) {
+		return -1;
+	}
+
+	for (int i = 0; i < src.height; i++) {
+
+		//pointer for source
+		const uchar* rptr = src.row<uchar>(i);
+
+		//pointer for destination
+		uchar* dptr = dst.row<uchar>(i);
+
+		for (int j = 0; j < src.width; j++) {
+
+			for (int c = 0; c < 3; c++) {
+
+				int v = rptr[j * 3 + c];
+
+				//blue channels add shift
+				if (c == 0) {
+					//checking if value + shift goes out of bounds in either direction
+					if (v + shift > 255) {
+						dptr[j * 3 + c] = 255;
+					}
+					else if (v + shift < 0) {
+						dptr[j * 3 + c] = 0;
+					}
+					//otherwise add shift to source's value for this color
+					else {
+						dptr[j * 3 + c] = v + shift;
+					}
+				}
+				//green values are shifted in the opposite direction
+				else if (c == 1) {
+					//checking if value + shift goes out of bounds in either direction
+					if (v - shift > 255) {
+						dptr[j * 3 + c] = 255;
+					}
+					else if (v - shift < 0) {
+						dptr[j * 3 + c] = 0;
+					}
+					else {
+						dptr[j * 3 + c] = v - shift;
+					}
+				}
+				//red stays the same in this implementation
+				else {
+					dptr[j * 3 + c] = v;
+				}
+			}
+		}
+
+		pyramidRow(dst, i, pyr, pyrCount);
+	}
+
+	return 0;
+}
+
+
+//attempt to make an hdr image through histogram equalization
+//The algorithm comes from https://cromwell-intl.com/3d/histogram/
+//but the implementation is my own
+//It runs in two passes so an image filtered in pieces can be equalized as a whole: hdrHistogram
+//counts the values of each piece, hdrApply then equalizes each piece with the total.
+FILTER_KERNEL int hdrEQ(const ImageView &src, const ImageView &dst) {
+
+	//making histogram counting each instance of each 'value'
+	int64_t histo[256] = { 0 };
+
+	if (hdrHistogram(src, histo) != 0) {
+		return -1;
+	}
+	return hdrApply(src, dst, histo);
+}
+
+//adds the count of each 'value' (channel 2) in src to histo
+FILTER_KERNEL int hdrHistogram(const ImageView &src, int64_t histo[256]) {
+
+	if (!isBGR8(src)) {
+		return -1;
+	}
+
+	//looping through each pixel to count values for the histogram
+	for (int i = 0; i < src.height; i++) {
+
+		const uchar* rptr = src.row<uchar>(i);
+
+		for (int j = 0; j < src.width; j++) {
+			//increment the histogram element for this pixel's value
+			histo[rptr[j * 3 + 2]] += 1;
+		}
+
+	}
+
+	return 0;
+}
+
+//equalizes the values of src with histo, the histogram of the whole image src is part of
+FILTER_KERNEL int hdrApply(const ImageView &src, const ImageView &dst, const int64_t histo[256]) {
+
+	if (!isBGR8(src) || !fits(dst, src.width, src.height, IMAGE_BGR8)) {
+		return -1;
+	}
+
+	//initializing the cumulative density function array
+	//(64 bit, the counts of a large still overflow int)
+	int64_t cdf[256] = { 0 };
+
+	//calculating cumulative density function (sum of all values in histo
+	//lower than any value and including that value)
+	for (int x = 0; x < 256;x++) {
+		//first case, then the rest can be dynamic programming
+		if (x == 0) {
+			cdf[x] = histo[0];
+		}
+		else {
+			cdf[x] = histo[x] + cdf[x - 1];
+		}
+	}
+
+	//n is total number of pixels. An empty histogram can't equalize anything, and one with every
+	//value in bin 0 (all black) has nothing to spread, so the values are left as they are
+	int64_t n = cdf[255];
+	if (n <= 0) {
+		return -1;
+	}
+	if (n == cdf[0]) {
+		if (dst.data != src.data) {
+			for (int i = 0; i < src.height; i++) {
+				memcpy(dst.row<uchar>(i), src.row<uchar>(i), src.width * 3);
+			}
+		}
+		return 0;
+	}
+	//now going through each pixel and updating the value based on
+	//cdf and total num of pixels to equalize
+	for (int i = 0; i < src.height; i++) {
+
+		const uchar* rptr = src.row<uchar>(i);
+		uchar* dptr = dst.row<uchar>(i);
+
+		for (int j = 0; j < src.width; j++) {
+
+			//calculating the equalized value based on our histogram and cdf results
+			dptr[j * 3 + 2] = floor(255 * ( cdf[rptr[j * 3 + 2]] - cdf[0]) / (n - cdf[0]) );
+			//copying the hue/sat from source too
+			dptr[j * 3] = rptr[j * 3];
+			dptr[j * 3 + 1] = rptr[j * 3 + 1];
+
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,96 @@
+#pragma once
+//filter core header
+//The kernels on plain image views, with no OpenCV dependency, for callers that keep frames in
+//their own buffers (decoder output, shared memory, capture SDKs). The source and the destination
+//are both views onto caller memory; nothing is allocated for the result and nothing is copied
+//in or out. filter.h's cv::Mat functions are thin adapters over these.
+//
+//Every function returns 0, or -1 if a view is missing or has the wrong size or format for it (or
+//the scratch memory a kernel pads its source into can't be allocated).
+//Unless noted, dst may be the same view as src (the filter runs in place).
+
+#include <cstddef>
+#include <cstdint>
+
+enum ImageFormat {
+	IMAGE_GRAY8,     //1 x uint8 per pixel
+	IMAGE_BGR8,      //3 x uint8 per pixel, b g r
+	IMAGE_BGR16S     //3 x int16 per pixel, b g r (signed kernel output)
+};
+
+//a window of width x height pixels starting at data, rows 'stride' bytes apart.
+//If the view is part of a bigger image, halo* say how many real pixels exist past each edge;
+//kernels that read neighbours use those and only extend the edge (setFilterBorder) past them.
+struct ImageView {
+	uint8_t* data = nullptr;
+	int width = 0;
+	int height = 0;
+	size_t stride = 0;
+	ImageFormat format = IMAGE_BGR8;
+	int haloTop = 0;
+	int haloBottom = 0;
+	int haloLeft = 0;
+	int haloRight = 0;
+
+	ImageView() {}
+	ImageView(void* data, int width, int height, size_t stride, ImageFormat format)
+		: data(static_cast<uint8_t*>(data)), width(width), height(height), stride(stride), format(format) {}
+
+	template <typename T>
+	T* row(int i) const {
+		return reinterpret_cast<T*>(data + static_cast<std::ptrdiff_t>(i) * stride);
+	}
+
+	//the w x h window at (x, y), which keeps the rest of this view (and its halo) as its halo.
+	//Empty if the rectangle isn't inside this view.
+	ImageView window(int x, int y, int w, int h) const;
+};
+
+//bytes per pixel of a format
+int formatBytes(ImageFormat format);
+
+//name of the kernel variant picked for this cpu at startup (sse2, avx2, avx512 or native)
+const char* filterIsa();
+
+//pixels past an edge the kernels read at most (the 5x5 blur). A window with this much real halo
+//around it filters the same as the whole image does there.
+enum { FILTER_APRON = 2 };
+
+//how kernels extend the image past its edges: repeat the edge pixel (default) or mirror the image
+enum { FILTER_BORDER_REPLICATE, FILTER_BORDER_REFLECT };
+void setFilterBorder(int mode);
+
+//blur5x5, blurQuantize, cartoon, cartoonCombine, cartoonMasked and colorshift can also fill
+//pyrCount pyramid levels in the same pass: pyr[0] is the half size (rounded down) version of dst,
+//pyr[1] half of that and so on, all IMAGE_BGR8.
+
+//gradX and the sobels write the signed result to an IMAGE_BGR16S dst, or |v| saturated to 0-255
+//(display ready) to an IMAGE_BGR8 one
+int gradX(const ImageView &src, const ImageView &dst);
+int grayScale(const ImageView &src, const ImageView &dst);
+int blur5x5(const ImageView &src, const ImageView &dst, const ImageView *pyr = nullptr, int pyrCount = 0);
+int sobelX3x3(const ImageView &src, const ImageView &dst);
+int sobelY3x3(const ImageView &src, const ImageView &dst);
+//IMAGE_BGR16S src (a signed kernel result) to IMAGE_BGR8 |v| saturated to 0-255, as the kernels
+//write it to an IMAGE_BGR8 dst
+int absSaturate(const ImageView &src, const ImageView &dst);
+int magnitude(const ImageView &sx, const ImageView &sy, const ImageView &dst);
+int blurQuantize(const ImageView &src, const ImageView &dst, int levels, const ImageView *pyr = nullptr, int pyrCount = 0);
+//blurQuantize's quantize step alone, on a blur5x5 result: the same output as blurQuantize of the original
+int quantize(const ImageView &blurred, const ImageView &dst, int levels);
+int cartoon(const ImageView &src, const ImageView &dst, int levels, int magThreshold, const ImageView *pyr = nullptr, int pyrCount = 0);
+//the last step of cartoon on sobels and a blurQuantize result that were already computed
+int cartoonCombine(const ImageView &sx, const ImageView &sy, const ImageView &quant, const ImageView &dst,
+	int magThreshold, const ImageView *pyr = nullptr, int pyrCount = 0);
+//cartoon's edge test alone: IMAGE_GRAY8 mask, 255 on edges and 0 elsewhere
+int edgeMask(const ImageView &src, const ImageView &mask, int magThreshold);
+//cartoon with an edge mask made earlier (edgeMask)
+int cartoonMasked(const ImageView &src, const ImageView &mask, const ImageView &dst, int levels,
+	const ImageView *pyr = nullptr, int pyrCount = 0);
+int pixelate(const ImageView &src, const ImageView &dst, int scale);
+int movement(const ImageView &src, const ImageView &last, const ImageView &dst, int sens);
+int colorshift(const ImageView &src, const ImageView &dst, int shift, const ImageView *pyr = nullptr, int pyrCount = 0);
+int hdrEQ(const ImageView &src, const ImageView &dst);
+int hdrHistogram(const ImageView &src, int64_t histo[256]);
+//equalizes with a histogram of the whole image (hdrHistogram); -1 if histo is empty
+int hdrApply(const ImageView &src, const ImageView &dst, const int64_t histo[256]);
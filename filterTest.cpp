@@ -0,0 +1,242 @@
+/*
+	Regression check for the filter kernels (ctest runs it as filterTest).
+
+	For a set of frame sizes, down to 1x1 and 2x2, and both border modes it checks that:
+	- blur5x5 and the sobels match a plain reference on a frame padded by cv::copyMakeBorder
+	  (BORDER_REPLICATE / BORDER_REFLECT_101, which is what FILTER_BORDER_REFLECT mirrors like)
+	- filtering a window() of a frame gives the same pixels as filtering the whole frame there
+	- filtering in place gives the same result as into a separate dst
+	- the display output of gradX and the sobels (disp) matches convertScaleAbs of the 16-bit result
+	- quantize of a blur matches blurQuantize, and cartoon matches cartoonCombine of its parts
+
+	usage: filterTest
+	exits 0 if the checks pass
+*/
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "filter.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+
+	if (!ok) {
+		fprintf(stderr, "FAIL %s\n", what.c_str());
+		failures++;
+	}
+}
+
+//true if a and b have the same size, type and bytes
+static bool same(const cv::Mat& a, const cv::Mat& b) {
+
+	if (a.size() != b.size() || a.type() != b.type()) {
+		return false;
+	}
+	size_t rowBytes = a.cols * a.elemSize();
+	for (int i = 0; i < a.rows; i++) {
+		if (memcmp(a.ptr(i), b.ptr(i), rowBytes) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//a frame with noise, flat patches and hard edges, so every border and bucket gets exercised
+static cv::Mat testFrame(int width, int height, uint32_t seed) {
+
+	cv::Mat frame(height, width, CV_8UC3);
+	uint32_t x = seed * 2654435761u + 1;
+	for (int i = 0; i < height; i++) {
+		uchar* rptr = frame.ptr<uchar>(i);
+		for (int k = 0; k < width * 3; k++) {
+			x = x * 1664525u + 1013904223u;
+			rptr[k] = ((i / 4 + k / 12) & 1) ? static_cast<uchar>(x >> 24) : ((x >> 31) ? 255 : 0);
+		}
+	}
+	return frame;
+}
+
+static ImageView coreView(const cv::Mat& m, ImageFormat format) {
+	return ImageView(m.data, m.cols, m.rows, m.step, format);
+}
+
+//blur5x5 on a frame padded by OpenCV, with the kernel's own rounding: rows summed, columns summed, / 100
+static cv::Mat referenceBlur(const cv::Mat& src, int border) {
+
+	cv::Mat pad;
+	cv::copyMakeBorder(src, pad, 2, 2, 2, 2, border);
+	static const int w[5] = { 1, 2, 4, 2, 1 };
+	cv::Mat dst(src.size(), CV_8UC3);
+	for (int i = 0; i < src.rows; i++) {
+		for (int k = 0; k < src.cols * 3; k++) {
+			int sum = 0;
+			for (int a = 0; a < 5; a++) {
+				int row = 0;
+				for (int b = 0; b < 5; b++) {
+					row += w[b] * pad.ptr<uchar>(i + a)[k + b * 3];
+				}
+				sum += w[a] * row;
+			}
+			dst.ptr<uchar>(i)[k] = sum / 100;
+		}
+	}
+	return dst;
+}
+
+//16-bit sobel X / Y on a frame padded by OpenCV
+static cv::Mat referenceSobel(const cv::Mat& src, int border, bool y) {
+
+	cv::Mat pad;
+	cv::copyMakeBorder(src, pad, 1, 1, 1, 1, border);
+	cv::Mat dst(src.size(), CV_16SC3);
+	for (int i = 0; i < src.rows; i++) {
+		const uchar* m1 = pad.ptr<uchar>(i);
+		const uchar* r = pad.ptr<uchar>(i + 1);
+		const uchar* p1 = pad.ptr<uchar>(i + 2);
+		for (int k = 3; k < (src.cols + 1) * 3; k++) {
+			int v = y ? (p1[k - 3] + 2 * p1[k] + p1[k + 3]) - (m1[k - 3] + 2 * m1[k] + m1[k + 3])
+				: (m1[k + 3] - m1[k - 3]) + 2 * (r[k + 3] - r[k - 3]) + (p1[k + 3] - p1[k - 3]);
+			dst.ptr<short>(i)[k - 3] = static_cast<short>(v);
+		}
+	}
+	return dst;
+}
+
+//every kernel with a BGR8 src, by name, run on cv::Mats
+struct Kernel {
+	const char* name;
+	int type;            //dst type
+	bool inPlace;        //dst may be src
+	bool windowed;       //a window filters like the whole frame (pixelate's blocks start at the window's corner)
+	int (*run)(cv::Mat& src, cv::Mat& dst);
+};
+
+static const Kernel kernels[] = {
+	{ "gradX", CV_16SC3, false, true, [](cv::Mat& s, cv::Mat& d) { return gradX(s, d); } },
+	{ "gradX disp", CV_8UC3, true, true, [](cv::Mat& s, cv::Mat& d) { return gradX(s, d, true); } },
+	{ "grayScale", CV_8UC1, false, true, [](cv::Mat& s, cv::Mat& d) { return grayScale(s, d); } },
+	{ "blur5x5", CV_8UC3, true, true, [](cv::Mat& s, cv::Mat& d) { return blur5x5(s, d); } },
+	{ "sobelX3x3", CV_16SC3, false, true, [](cv::Mat& s, cv::Mat& d) { return sobelX3x3(s, d); } },
+	{ "sobelY3x3", CV_16SC3, false, true, [](cv::Mat& s, cv::Mat& d) { return sobelY3x3(s, d); } },
+	{ "sobelX3x3 disp", CV_8UC3, true, true, [](cv::Mat& s, cv::Mat& d) { return sobelX3x3(s, d, true); } },
+	{ "sobelY3x3 disp", CV_8UC3, true, true, [](cv::Mat& s, cv::Mat& d) { return sobelY3x3(s, d, true); } },
+	{ "blurQuantize", CV_8UC3, true, true, [](cv::Mat& s, cv::Mat& d) { return blurQuantize(s, d, 5); } },
+	{ "cartoon", CV_8UC3, true, true, [](cv::Mat& s, cv::Mat& d) { return cartoon(s, d, 5, 20); } },
+	{ "pixelate", CV_8UC3, true, false, [](cv::Mat& s, cv::Mat& d) { return pixelate(s, d, 3); } },
+	{ "colorshift", CV_8UC3, true, true, [](cv::Mat& s, cv::Mat& d) { return colorshift(s, d, 70); } },
+};
+
+//a window in the middle, one on two opposite corners and the whole frame
+static std::vector<cv::Rect> windowsOf(int width, int height) {
+
+	int w = std::max(width / 2, 1);
+	int h = std::max(height / 2, 1);
+	return { cv::Rect(width / 4, height / 4, w, h), cv::Rect(0, 0, w, h), cv::Rect(width - w, height - h, w, h),
+		cv::Rect(0, 0, width, height) };
+}
+
+static void checkFrame(int width, int height, int border) {
+
+	char tag[64];
+	snprintf(tag, sizeof(tag), " %dx%d %s", width, height, border == cv::BORDER_REPLICATE ? "replicate" : "reflect");
+	setFilterBorder(border == cv::BORDER_REPLICATE ? FILTER_BORDER_REPLICATE : FILTER_BORDER_REFLECT);
+	cv::Mat src = testFrame(width, height, width * 131 + height + border);
+
+	//borders against OpenCV's padding
+	cv::Mat out;
+	check(blur5x5(src, out) == 0 && same(out, referenceBlur(src, border)), std::string("blur5x5 border") + tag);
+	check(sobelX3x3(src, out) == 0 && same(out, referenceSobel(src, border, false)), std::string("sobelX3x3 border") + tag);
+	check(sobelY3x3(src, out) == 0 && same(out, referenceSobel(src, border, true)), std::string("sobelY3x3 border") + tag);
+
+	for (const Kernel& k : kernels) {
+		std::string name = std::string(k.name) + tag;
+		cv::Mat whole;
+		cv::Mat input = src.clone();
+		check(k.run(input, whole) == 0 && whole.type() == k.type && same(input, src), name + " whole frame");
+
+		//windows as cv::Mat ROIs, written in place into a dst of the right size
+		for (const cv::Rect& r : k.windowed ? windowsOf(width, height) : std::vector<cv::Rect>()) {
+			cv::Mat part(r.size(), k.type);
+			cv::Mat roi = src(r);
+			cv::Mat got = part;
+			check(k.run(roi, got) == 0 && got.data == part.data && same(part, whole(r)), name + " window");
+		}
+
+		//in place into the frame itself
+		if (k.inPlace) {
+			cv::Mat frame = src.clone();
+			cv::Mat dst = frame;
+			check(k.run(frame, dst) == 0 && dst.data == frame.data && same(frame, whole), name + " in place");
+		}
+	}
+
+	//the same through ImageView::window(), without the cv::Mat adapters
+	cv::Mat whole;
+	blur5x5(src, whole);
+	for (const cv::Rect& r : windowsOf(width, height)) {
+		cv::Mat part(r.size(), CV_8UC3);
+		ImageView window = coreView(src, IMAGE_BGR8).window(r.x, r.y, r.width, r.height);
+		check(window.data != nullptr && blur5x5(window, coreView(part, IMAGE_BGR8)) == 0 && same(part, whole(r)),
+			std::string("blur5x5 ImageView window") + tag);
+	}
+
+	//display output against convertScaleAbs of the 16-bit result
+	cv::Mat wide;
+	cv::Mat disp;
+	cv::Mat scaled;
+	gradX(src, wide);
+	gradX(src, disp, true);
+	cv::convertScaleAbs(wide, scaled);
+	check(same(disp, scaled), std::string("gradX disp") + tag);
+	sobelX3x3(src, wide);
+	sobelX3x3(src, disp, true);
+	cv::convertScaleAbs(wide, scaled);
+	check(same(disp, scaled), std::string("sobelX3x3 disp") + tag);
+	check(absSaturate(wide, disp) == 0 && same(disp, scaled), std::string("absSaturate") + tag);
+	sobelY3x3(src, wide);
+	sobelY3x3(src, disp, true);
+	cv::convertScaleAbs(wide, scaled);
+	check(same(disp, scaled), std::string("sobelY3x3 disp") + tag);
+
+	//the split up filters against the fused ones
+	cv::Mat blurred;
+	cv::Mat fused;
+	cv::Mat split;
+	blur5x5(src, blurred);
+	for (int levels = 1; levels <= 8; levels++) {
+		blurQuantize(src, fused, levels);
+		check(quantize(blurred, split, levels) == 0 && same(fused, split), std::string("quantize") + tag);
+	}
+	cv::Mat sx;
+	cv::Mat sy;
+	sobelX3x3(src, sx);
+	sobelY3x3(src, sy);
+	cartoon(src, fused, 5, 20);
+	blurQuantize(src, split, 5);
+	check(cartoonCombine(coreView(sx, IMAGE_BGR16S), coreView(sy, IMAGE_BGR16S), coreView(split, IMAGE_BGR8),
+		coreView(split, IMAGE_BGR8), 20) == 0 && same(fused, split), std::string("cartoonCombine") + tag);
+}
+
+int main() {
+
+	const cv::Size sizes[] = { cv::Size(1, 1), cv::Size(2, 2), cv::Size(1, 5), cv::Size(5, 1), cv::Size(3, 4),
+		cv::Size(17, 9), cv::Size(64, 48), cv::Size(101, 77) };
+	for (const cv::Size& s : sizes) {
+		checkFrame(s.width, s.height, cv::BORDER_REPLICATE);
+		checkFrame(s.width, s.height, cv::BORDER_REFLECT_101);
+	}
+	setFilterBorder(FILTER_BORDER_REPLICATE);
+
+	//windows that don't fit are refused
+	cv::Mat frame = testFrame(8, 8, 1);
+	ImageView v = coreView(frame, IMAGE_BGR8);
+	check(v.window(4, 4, 5, 1).data == nullptr && v.window(-1, 0, 2, 2).data == nullptr &&
+		v.window(0, 0, 0, 1).data == nullptr, "window bounds");
+
+	printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+	return failures == 0 ? 0 : 1;
+}
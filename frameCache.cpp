@@ -0,0 +1,98 @@
+//per-frame intermediate cache
+//computes shared filter intermediates at most once per frame
+
+#include <opencv2/opencv.hpp>
+#include "filter.h"
+#include "frameCache.h"
+
+FrameCache::FrameCache(int maxEntries) : seq(0), missCount(0), hitCount(0) {
+
+	for (int e = 0; e < maxEntries; e++) {
+		entries.emplace_back(new Entry());
+	}
+}
+
+void FrameCache::beginFrame(uint64_t frameSeq, const cv::Mat& frame) {
+
+	std::lock_guard<std::mutex> guard(lock);
+	//sequence 0 is never a valid frame, so fresh entries can't match
+	seq = frameSeq + 1;
+	current = frame;
+}
+
+void FrameCache::compute(CacheProducer producer, int param, cv::Mat& out) {
+
+	switch (producer) {
+	case CACHE_GRAY:
+		grayScale(current, out);
+		break;
+	case CACHE_BLUR:
+		blur5x5(current, out);
+		break;
+	case CACHE_SOBEL_X:
+		sobelX3x3(current, out);
+		break;
+	case CACHE_SOBEL_Y:
+		sobelY3x3(current, out);
+		break;
+	case CACHE_QUANTIZE: {
+		//from the cached blur, so blur and quantize users share one blur pass. Blur never
+		//depends on quantize, so waiting on its entry here can't deadlock.
+		cv::Mat blurred = get(CACHE_BLUR);
+		quantize(blurred, out, param);
+		break;
+	}
+	}
+}
+
+cv::Mat FrameCache::get(CacheProducer producer, int param) {
+
+	Entry* e = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		//already cached (or being computed) for this frame
+		for (auto& x : entries) {
+			if (x->seq == seq && x->producer == producer && x->param == param) {
+				e = x.get();
+				break;
+			}
+		}
+
+		//otherwise claim a stale entry, preferring one that held the same producer last frame
+		//so its buffer is simply overwritten
+		if (e == nullptr) {
+			for (auto& x : entries) {
+				if (x->seq != seq && (e == nullptr || (x->producer == producer && x->param == param))) {
+					e = x.get();
+				}
+			}
+			if (e != nullptr) {
+				e->seq = seq;
+				e->producer = producer;
+				e->param = param;
+				e->ready = false;
+			}
+		}
+	}
+
+	//every entry is in use this frame - compute without caching rather than grow
+	if (e == nullptr) {
+		cv::Mat out;
+		compute(producer, param, out);
+		missCount++;
+		return out;
+	}
+
+	//the entry lock makes a second thread asking for the same result wait for the first
+	std::lock_guard<std::mutex> guard(e->lock);
+	if (!e->ready) {
+		compute(producer, param, e->value);
+		e->ready = true;
+		missCount++;
+	}
+	else {
+		hitCount++;
+	}
+	return e->value;
+}
@@ -0,0 +1,60 @@
+#pragma once
+//per-frame intermediate cache header
+//Sobel X/Y, blur, blur/quantize and grayscale results are shared by several filters. When more
+//than one output is wanted from the same frame, FrameCache computes each of them at most once
+//per frame and hands the same result to every filter that asks.
+//
+//Entries are keyed by frame sequence number, producer and parameter. Memory is bounded by a fixed
+//number of entries; everything cached for a frame is evicted by beginFrame() of the next one,
+//but the buffers stay allocated so the next frame's results are written into them again.
+//get() may be called from several threads at once; beginFrame() must not overlap with get().
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+enum CacheProducer {
+	CACHE_GRAY,       //grayScale
+	CACHE_BLUR,       //blur5x5
+	CACHE_SOBEL_X,    //sobelX3x3
+	CACHE_SOBEL_Y,    //sobelY3x3
+	CACHE_QUANTIZE    //blurQuantize (quantize of CACHE_BLUR), param = levels
+};
+
+class FrameCache {
+public:
+	explicit FrameCache(int maxEntries = 8);
+
+	//starts frame seq; results for earlier frames are evicted
+	void beginFrame(uint64_t seq, const cv::Mat& frame);
+	//result of producer for the current frame, computed on first use. Treat it as read-only;
+	//it is valid until the next beginFrame().
+	cv::Mat get(CacheProducer producer, int param = 0);
+
+	const cv::Mat& frame() const { return current; }
+	//how many results were computed / served from the cache since construction
+	uint64_t misses() const { return missCount.load(); }
+	uint64_t hits() const { return hitCount.load(); }
+
+private:
+	struct Entry {
+		std::mutex lock;
+		uint64_t seq = 0;
+		int producer = -1;
+		int param = 0;
+		bool ready = false;
+		cv::Mat value;
+	};
+
+	void compute(CacheProducer producer, int param, cv::Mat& out);
+
+	std::mutex lock;
+	std::vector<std::unique_ptr<Entry>> entries;
+	uint64_t seq;
+	cv::Mat current;
+	std::atomic<uint64_t> missCount;
+	std::atomic<uint64_t> hitCount;
+};
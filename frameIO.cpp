@@ -0,0 +1,368 @@
+//raw frame I/O
+//raw BGR and Y4M readers (memory-mapped or piped) and writers
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <opencv2/opencv.hpp>
+#include "frameIO.h"
+
+
+FrameFormat formatFromPath(const std::string& path) {
+
+	size_t dot = path.rfind('.');
+	if (dot != std::string::npos && path.compare(dot, std::string::npos, ".y4m") == 0) {
+		return FRAME_Y4M;
+	}
+	return FRAME_RAW_BGR;
+}
+
+
+FrameReader::FrameReader() : format(FRAME_RAW_BGR), frameRate(30), fd(-1), ownFd(false),
+	map(nullptr), mapLength(0), offset(0), mono(false) {
+}
+
+FrameReader::~FrameReader() {
+	close();
+}
+
+bool FrameReader::open(const std::string& path, FrameFormat fmt, cv::Size size, double fps) {
+
+	close();
+	format = fmt;
+	frameSize = size;
+	frameRate = fps > 0 ? fps : 30;
+
+	if (path == "-") {
+		fd = STDIN_FILENO;
+		ownFd = false;
+	}
+	else {
+		fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			fprintf(stderr, "Unable to open %s: %s\n", path.c_str(), strerror(errno));
+			return false;
+		}
+		ownFd = true;
+	}
+
+	//regular files (including a redirected stdin) are mapped, pipes are read into a buffer.
+	//The mapping is private and writable so filters working in place on a frame only touch
+	//copy-on-write pages and never the file.
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void* m = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (m != MAP_FAILED) {
+			map = static_cast<uchar*>(m);
+			mapLength = st.st_size;
+			offset = 0;
+			madvise(map, mapLength, MADV_SEQUENTIAL);
+		}
+	}
+
+	if (format == FRAME_Y4M) {
+		std::string header;
+		if (!readLine(header) || !parseY4MHeader(header)) {
+			fprintf(stderr, "%s is not a supported y4m stream\n", path.c_str());
+			close();
+			return false;
+		}
+	}
+
+	if (frameSize.width <= 0 || frameSize.height <= 0) {
+		fprintf(stderr, "Frame size needed for raw input (-s WxH)\n");
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void FrameReader::close() {
+
+	if (map != nullptr) {
+		munmap(map, mapLength);
+		map = nullptr;
+	}
+	if (ownFd && fd >= 0) {
+		::close(fd);
+	}
+	fd = -1;
+	ownFd = false;
+	mapLength = 0;
+	offset = 0;
+}
+
+//returns a pointer to the next n bytes of input, or nullptr at end of stream.
+//Mapped input returns a pointer into the mapping, pipes fill the reused buffer.
+const uchar* FrameReader::fetch(size_t n) {
+
+	if (map != nullptr) {
+		if (mapLength - offset < n) {
+			return nullptr;
+		}
+		const uchar* p = map + offset;
+		offset += n;
+		return p;
+	}
+
+	if (buffer.size() < n) {
+		buffer.resize(n);
+	}
+	size_t got = 0;
+	while (got < n) {
+		ssize_t r = ::read(fd, buffer.data() + got, n - got);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return nullptr;
+		}
+		got += r;
+	}
+	return buffer.data();
+}
+
+//reads one '\n' terminated line (used for the y4m stream and frame headers)
+bool FrameReader::readLine(std::string& line) {
+
+	line.clear();
+	for (;;) {
+		const uchar* c = fetch(1);
+		if (c == nullptr) {
+			return false;
+		}
+		if (*c == '\n') {
+			return true;
+		}
+		line += static_cast<char>(*c);
+	}
+}
+
+//YUV4MPEG2 W<w> H<h> F<n>:<d> I<i> A<a>:<b> C<colorspace> ...
+bool FrameReader::parseY4MHeader(const std::string& line) {
+
+	if (line.compare(0, 9, "YUV4MPEG2") != 0) {
+		return false;
+	}
+
+	std::string colorspace = "420jpeg";
+	size_t pos = 9;
+	while (pos < line.size()) {
+		size_t end = line.find(' ', pos + 1);
+		if (end == std::string::npos) {
+			end = line.size();
+		}
+		std::string tok = line.substr(pos + 1, end - pos - 1);
+		if (!tok.empty()) {
+			switch (tok[0]) {
+			case 'W':
+				frameSize.width = atoi(tok.c_str() + 1);
+				break;
+			case 'H':
+				frameSize.height = atoi(tok.c_str() + 1);
+				break;
+			case 'F': {
+				int n = 0;
+				int d = 0;
+				if (sscanf(tok.c_str() + 1, "%d:%d", &n, &d) == 2 && n > 0 && d > 0) {
+					frameRate = static_cast<double>(n) / d;
+				}
+				break;
+			}
+			case 'C':
+				colorspace = tok.substr(1);
+				break;
+			}
+		}
+		pos = end;
+	}
+
+	//all 8 bit 4:2:0 siting variants share the same plane layout. Deeper streams (420p10, mono16...)
+	//have 2 byte samples and are refused rather than read as garbage.
+	if (colorspace == "420" || colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2") {
+		mono = false;
+	}
+	else if (colorspace == "mono") {
+		mono = true;
+	}
+	else if (colorspace.compare(0, 4, "420p") == 0 || colorspace.compare(0, 4, "mono") == 0) {
+		fprintf(stderr, "Unsupported y4m colorspace C%s (only 8 bit samples are read)\n", colorspace.c_str());
+		return false;
+	}
+	else {
+		fprintf(stderr, "Unsupported y4m colorspace C%s (need 420 or mono)\n", colorspace.c_str());
+		return false;
+	}
+
+	//4:2:0 needs even dimensions
+	return frameSize.width > 0 && frameSize.height > 0 &&
+		(mono || (frameSize.width % 2 == 0 && frameSize.height % 2 == 0));
+}
+
+bool FrameReader::read(cv::Mat& frame) {
+
+	if (fd < 0) {
+		return false;
+	}
+
+	size_t w = frameSize.width;
+	size_t h = frameSize.height;
+
+	if (format == FRAME_RAW_BGR) {
+		const uchar* p = fetch(w * h * 3);
+		if (p == nullptr) {
+			return false;
+		}
+		//zero-copy: the Mat header points straight at the mapped (or buffered) frame
+		frame = cv::Mat(frameSize, CV_8UC3, const_cast<uchar*>(p));
+		return true;
+	}
+
+	//y4m: every frame starts with a FRAME line that may carry parameters we ignore
+	std::string line;
+	if (!readLine(line) || line.compare(0, 5, "FRAME") != 0) {
+		return false;
+	}
+
+	if (mono) {
+		const uchar* p = fetch(w * h);
+		if (p == nullptr) {
+			return false;
+		}
+		cv::Mat y(frameSize, CV_8UC1, const_cast<uchar*>(p));
+		cv::cvtColor(y, bgr, cv::COLOR_GRAY2BGR);
+	}
+	else {
+		//Y, U and V planes are contiguous, so they can be viewed as one I420 image
+		const uchar* p = fetch(w * h * 3 / 2);
+		if (p == nullptr) {
+			return false;
+		}
+		cv::Mat i420(frameSize.height * 3 / 2, frameSize.width, CV_8UC1, const_cast<uchar*>(p));
+		cv::cvtColor(i420, bgr, cv::COLOR_YUV2BGR_I420);
+	}
+	frame = bgr;
+	return true;
+}
+
+
+FrameWriter::FrameWriter() : format(FRAME_RAW_BGR), fd(-1), ownFd(false) {
+}
+
+FrameWriter::~FrameWriter() {
+	close();
+}
+
+bool FrameWriter::open(const std::string& path, FrameFormat fmt, cv::Size size, double fps) {
+
+	close();
+	format = fmt;
+	frameSize = size;
+
+	if (path == "-") {
+		fd = STDOUT_FILENO;
+		ownFd = false;
+	}
+	else {
+		fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			fprintf(stderr, "Unable to open %s: %s\n", path.c_str(), strerror(errno));
+			return false;
+		}
+		ownFd = true;
+	}
+
+	if (format == FRAME_Y4M) {
+		if (size.width % 2 != 0 || size.height % 2 != 0) {
+			fprintf(stderr, "y4m output needs even frame dimensions\n");
+			close();
+			return false;
+		}
+		//frame rate as a rational with millihertz precision (cameras may report 0)
+		if (fps <= 0) {
+			fps = 30;
+		}
+		int num = static_cast<int>(fps * 1000 + 0.5);
+		int den = 1000;
+		if (num % 1000 == 0) {
+			num /= 1000;
+			den = 1;
+		}
+		char header[128];
+		int n = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n",
+			size.width, size.height, num, den);
+		if (!writeAll(header, n)) {
+			close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void FrameWriter::close() {
+
+	if (ownFd && fd >= 0) {
+		::close(fd);
+	}
+	fd = -1;
+	ownFd = false;
+}
+
+bool FrameWriter::writeAll(const void* data, size_t n) {
+
+	const char* p = static_cast<const char*>(data);
+	while (n > 0) {
+		ssize_t r = ::write(fd, p, n);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return false;
+		}
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+bool FrameWriter::write(const cv::Mat& frame) {
+
+	if (fd < 0 || frame.size() != frameSize) {
+		return false;
+	}
+
+	if (format == FRAME_Y4M) {
+		if (frame.channels() == 1) {
+			cv::cvtColor(frame, bgr, cv::COLOR_GRAY2BGR);
+			cv::cvtColor(bgr, yuv, cv::COLOR_BGR2YUV_I420);
+		}
+		else {
+			cv::cvtColor(frame, yuv, cv::COLOR_BGR2YUV_I420);
+		}
+		static const char tag[] = "FRAME\n";
+		return writeAll(tag, sizeof(tag) - 1) && writeAll(yuv.data, yuv.total() * yuv.elemSize());
+	}
+
+	//raw output is always 3 channel bgr24
+	const cv::Mat* out = &frame;
+	if (frame.channels() == 1) {
+		cv::cvtColor(frame, bgr, cv::COLOR_GRAY2BGR);
+		out = &bgr;
+	}
+
+	if (out->isContinuous()) {
+		return writeAll(out->data, out->total() * out->elemSize());
+	}
+	for (int i = 0; i < out->rows; i++) {
+		if (!writeAll(out->ptr(i), out->cols * out->elemSize())) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+//raw frame I/O header
+//Readers and writers for raw BGR (bgr24, no header) and Y4M streams, so frames can be fed to the
+//filters without a cv::VideoCapture decode. A path of "-" means stdin / stdout.
+
+#include <string>
+#include <opencv2/opencv.hpp>
+
+enum FrameFormat { FRAME_RAW_BGR, FRAME_Y4M };
+
+//picks the format from the file extension (.y4m), everything else is raw BGR
+FrameFormat formatFromPath(const std::string& path);
+
+
+//FrameReader memory-maps regular files (stdin included when it is redirected from a file) and
+//reads pipes into one reused buffer.
+//Raw BGR frames come back as cv::Mat views directly onto the mapping - no copy at all.
+//Y4M frames (4:2:0 or mono) are converted to BGR from a view onto the mapped planes.
+//The returned frame is only valid until the next call to read().
+class FrameReader {
+public:
+	FrameReader();
+	~FrameReader();
+
+	//raw BGR needs the frame size (and has no rate of its own, fps is just reported back), y4m
+	//takes both from the stream header
+	bool open(const std::string& path, FrameFormat format, cv::Size size = cv::Size(), double fps = 30);
+	bool read(cv::Mat& frame);
+	void close();
+
+	cv::Size size() const { return frameSize; }
+	double fps() const { return frameRate; }
+	bool isMapped() const { return map != nullptr; }
+
+private:
+	const uchar* fetch(size_t n);
+	bool readLine(std::string& line);
+	bool parseY4MHeader(const std::string& line);
+
+	FrameFormat format;
+	cv::Size frameSize;
+	double frameRate;
+	int fd;
+	bool ownFd;
+
+	//mapped input
+	uchar* map;
+	size_t mapLength;
+	size_t offset;
+
+	//pipe input
+	std::vector<uchar> buffer;
+
+	//y4m state
+	bool mono;
+	cv::Mat bgr;
+};
+
+
+//FrameWriter writes each frame with a single write() when the frame is continuous.
+//Y4M output is always C420jpeg.
+class FrameWriter {
+public:
+	FrameWriter();
+	~FrameWriter();
+
+	bool open(const std::string& path, FrameFormat format, cv::Size size, double fps = 30);
+	bool write(const cv::Mat& frame);
+	void close();
+
+private:
+	bool writeAll(const void* data, size_t n);
+
+	FrameFormat format;
+	cv::Size frameSize;
+	int fd;
+	bool ownFd;
+	cv::Mat bgr;
+	cv::Mat yuv;
+};
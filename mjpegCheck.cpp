@@ -0,0 +1,259 @@
+/*
+	Loopback check for the MJPEG server (vidDisplay -w).
+
+	Starts an MjpegServer on 127.0.0.1, connects several clients to it and posts numbered frames
+	(the number is drawn as a row of black/white blocks, which survives JPEG). Every client reads
+	the multipart stream part by part and decodes each JPEG. One client reads slowly, through a
+	small receive buffer. At the end it checks that every client got whole, decodable parts in
+	order, and that the slow reader skipped frames instead of holding the others up.
+
+	usage: mjpegCheck [-port N] [-clients N] [-frames N] [-slow ms]
+	exits 0 if the checks pass
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <opencv2/opencv.hpp>
+#include "mjpegServer.h"
+
+//frame number bits, drawn as BLOCK x BLOCK squares along the top of the frame
+static const int BITS = 16;
+static const int BLOCK = 32;
+
+static void drawNumber(cv::Mat& frame, int number) {
+
+	for (int b = 0; b < BITS; b++) {
+		cv::Scalar value = (number >> b) & 1 ? cv::Scalar(255, 255, 255) : cv::Scalar(0, 0, 0);
+		frame(cv::Rect(b * BLOCK, 0, BLOCK, BLOCK)).setTo(value);
+	}
+}
+
+static int readNumber(const cv::Mat& frame) {
+
+	int number = 0;
+	for (int b = 0; b < BITS; b++) {
+		if (frame.at<cv::Vec3b>(BLOCK / 2, b * BLOCK + BLOCK / 2)[1] > 127) {
+			number |= 1 << b;
+		}
+	}
+	return number;
+}
+
+//what one client saw
+struct ClientResult {
+	bool slow = false;
+	bool headerOk = false;
+	int parts = 0;
+	int bad = 0;             //parts that didn't decode or came out of order
+	int skipped = 0;         //frame numbers jumped over between consecutive parts
+};
+
+//buffered reads from a blocking socket
+struct StreamReader {
+	int fd;
+	std::string buf;
+
+	bool more() {
+		char chunk[65536];
+		ssize_t r = recv(fd, chunk, sizeof(chunk), 0);
+		if (r <= 0) {
+			return false;
+		}
+		buf.append(chunk, r);
+		return true;
+	}
+
+	//everything up to and including delim
+	bool until(const char* delim, std::string& out) {
+		size_t at;
+		while ((at = buf.find(delim)) == std::string::npos) {
+			if (!more()) {
+				return false;
+			}
+		}
+		at += strlen(delim);
+		out.assign(buf, 0, at);
+		buf.erase(0, at);
+		return true;
+	}
+
+	bool exactly(size_t n, std::string& out) {
+		while (buf.size() < n) {
+			if (!more()) {
+				return false;
+			}
+		}
+		out.assign(buf, 0, n);
+		buf.erase(0, n);
+		return true;
+	}
+};
+
+static void runClient(int port, int slowMs, ClientResult& result) {
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return;
+	}
+	//the slow reader keeps its receive buffer small, so the server sees it as busy quickly
+	if (slowMs > 0) {
+		int size = 16 * 1024;
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	}
+	struct timeval timeout = { 5, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	const char request[] = "GET / HTTP/1.0\r\n\r\n";
+	if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+		send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(request) - 1)) {
+		close(fd);
+		return;
+	}
+
+	StreamReader in = { fd, std::string() };
+	std::string header;
+	if (!in.until("\r\n\r\n", header)) {
+		close(fd);
+		return;
+	}
+	result.headerOk = header.compare(0, 12, "HTTP/1.0 200") == 0 &&
+		header.find("multipart/x-mixed-replace; boundary=vidframe") != std::string::npos;
+
+	//each part: boundary and headers, Content-Length bytes of JPEG, CRLF. The stream ends when
+	//the server stops.
+	int last = -1;
+	std::string partHeader;
+	std::string body;
+	while (in.until("\r\n\r\n", partHeader)) {
+		size_t at = partHeader.find("Content-Length: ");
+		if (partHeader.compare(0, 10, "--vidframe") != 0 || at == std::string::npos) {
+			result.bad++;
+			break;
+		}
+		size_t length = strtoul(partHeader.c_str() + at + 16, nullptr, 10);
+		if (!in.exactly(length + 2, body)) {
+			break;
+		}
+		result.parts++;
+
+		cv::Mat jpeg(1, static_cast<int>(length), CV_8U, &body[0]);
+		cv::Mat frame = cv::imdecode(jpeg, cv::IMREAD_COLOR);
+		if (frame.empty() || body.compare(length, 2, "\r\n") != 0) {
+			result.bad++;
+			continue;
+		}
+		int number = readNumber(frame);
+		if (number <= last) {
+			result.bad++;
+		}
+		else if (last >= 0) {
+			result.skipped += number - last - 1;
+		}
+		last = number;
+
+		if (slowMs > 0) {
+			usleep(slowMs * 1000);
+		}
+	}
+	close(fd);
+}
+
+int main(int argc, char* argv[]) {
+
+	int port = 18080;
+	int clientCount = 4;
+	int frames = 90;
+	int slowMs = 200;
+	for (int a = 1; a < argc; a++) {
+		bool hasValue = a + 1 < argc;
+		if (strcmp(argv[a], "-port") == 0 && hasValue) {
+			port = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-clients") == 0 && hasValue) {
+			clientCount = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-frames") == 0 && hasValue) {
+			frames = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-slow") == 0 && hasValue) {
+			slowMs = atoi(argv[++a]);
+		}
+		else {
+			fprintf(stderr, "usage: %s [-port N] [-clients N] [-frames N] [-slow ms]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (clientCount < 2 || frames < 2 || frames >= 1 << BITS) {
+		fprintf(stderr, "Need at least 2 clients and 2 to %d frames\n", (1 << BITS) - 1);
+		return -1;
+	}
+
+	MjpegServer server;
+	if (!server.start(port, "127.0.0.1")) {
+		return -1;
+	}
+
+	//client 0 is the slow one
+	std::vector<ClientResult> results(clientCount);
+	std::vector<std::thread> clients;
+	for (int c = 0; c < clientCount; c++) {
+		results[c].slow = c == 0;
+		clients.emplace_back(runClient, port, c == 0 ? slowMs : 0, std::ref(results[c]));
+	}
+
+	//the server only encodes while someone is watching
+	for (int wait = 0; server.clients() < clientCount && wait < 500; wait++) {
+		usleep(10000);
+	}
+	if (server.clients() < clientCount) {
+		fprintf(stderr, "Only %d of %d clients connected\n", server.clients(), clientCount);
+	}
+
+	//noise makes the frames big enough to fill the slow reader's socket
+	cv::Mat frame(480, 640, CV_8UC3);
+	cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+	for (int f = 0; f < frames; f++) {
+		drawNumber(frame, f);
+		server.post(frame);
+		usleep(33000);
+	}
+	//let the last frame reach the fast clients, then close every connection
+	usleep(200000);
+	uint64_t encoded = server.encoded();
+	server.stop();
+	for (std::thread& t : clients) {
+		t.join();
+	}
+
+	printf("posted %d  encoded %llu\n", frames, static_cast<unsigned long long>(encoded));
+	bool ok = encoded > 0;
+	int fastParts = 0;
+	for (int c = 0; c < clientCount; c++) {
+		const ClientResult& r = results[c];
+		printf("client %d%s  parts %d  skipped %d  bad %d%s\n", c, r.slow ? " (slow)" : "       ", r.parts,
+			r.skipped, r.bad, r.headerOk ? "" : "  bad response header");
+		ok = ok && r.headerOk && r.parts > 0 && r.bad == 0 && r.parts <= static_cast<int>(encoded);
+		if (!r.slow) {
+			fastParts = fastParts == 0 ? r.parts : std::min(fastParts, r.parts);
+		}
+	}
+	//the slow reader must have skipped ahead, and must not have slowed the others down to its pace
+	ok = ok && results[0].skipped > 0 && fastParts > results[0].parts;
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,386 @@
+//MJPEG over HTTP output
+//encoder thread + epoll fan-out of one shared encoded buffer per frame
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <opencv2/opencv.hpp>
+#include "mjpegServer.h"
+
+static const char RESPONSE_HEADER[] =
+	"HTTP/1.0 200 OK\r\n"
+	"Cache-Control: no-cache, no-store\r\n"
+	"Pragma: no-cache\r\n"
+	"Connection: close\r\n"
+	"Content-Type: multipart/x-mixed-replace; boundary=vidframe\r\n"
+	"\r\n";
+
+//limit on the request we read before streaming, anything longer isn't a browser GET
+static const size_t MAX_REQUEST = 8192;
+
+//per connection state: the request being read, then one part being sent
+struct MjpegServer::Client {
+	int fd;
+	bool streaming;          //request has been read
+	bool wantWrite;          //EPOLLOUT is armed
+	std::string request;
+	size_t headerSent;       //bytes of RESPONSE_HEADER sent
+	Part part;               //part being sent, shared with the other clients
+	size_t partSent;
+	uint64_t partSeq;        //frame number of part (0 = nothing sent yet)
+};
+
+
+MjpegServer::MjpegServer() : quality(80), listenFd(-1), epollFd(-1), wakeFd(-1), running(false),
+	hasPending(false), latestSeq(0), clientCount(0), encodedCount(0) {
+}
+
+MjpegServer::~MjpegServer() {
+	stop();
+}
+
+bool MjpegServer::start(int port, const std::string& address, int q) {
+
+	stop();
+	quality = q;
+
+	listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFd < 0) {
+		fprintf(stderr, "Unable to create socket: %s\n", strerror(errno));
+		return false;
+	}
+	int one = 1;
+	setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1 ||
+		bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+		listen(listenFd, 64) != 0) {
+		fprintf(stderr, "Unable to listen on %s:%d: %s\n", address.c_str(), port, strerror(errno));
+		close(listenFd);
+		listenFd = -1;
+		return false;
+	}
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	//the listening socket and the wake eventfd are registered with a null ptr / the server itself
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = nullptr;
+	bool ready = epollFd >= 0 && wakeFd >= 0 && epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) == 0;
+	ev.data.ptr = this;
+	if (!ready || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) != 0) {
+		fprintf(stderr, "Unable to set up the event loop: %s\n", strerror(errno));
+		if (wakeFd >= 0) {
+			close(wakeFd);
+		}
+		if (epollFd >= 0) {
+			close(epollFd);
+		}
+		close(listenFd);
+		wakeFd = -1;
+		epollFd = -1;
+		listenFd = -1;
+		return false;
+	}
+
+	running = true;
+	encoder = std::thread(&MjpegServer::encodeLoop, this);
+	io = std::thread(&MjpegServer::ioLoop, this);
+	return true;
+}
+
+void MjpegServer::stop() {
+
+	if (!running) {
+		return;
+	}
+	running = false;
+	frameReady.notify_all();
+	uint64_t one = 1;
+	if (write(wakeFd, &one, sizeof(one)) < 0) {
+		//the io thread also wakes on its epoll timeout
+	}
+	encoder.join();
+	io.join();
+
+	close(wakeFd);
+	close(epollFd);
+	close(listenFd);
+	wakeFd = -1;
+	epollFd = -1;
+	listenFd = -1;
+	latest.reset();
+	latestSeq = 0;
+}
+
+void MjpegServer::post(const cv::Mat& frame) {
+
+	if (!running) {
+		return;
+	}
+	//skip the copy entirely when nobody is watching
+	if (clientCount.load() == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> guard(frameLock);
+	frame.copyTo(pending);
+	hasPending = true;
+	frameReady.notify_one();
+}
+
+//encodes the newest posted frame once and publishes it as a ready-to-send multipart part
+void MjpegServer::encodeLoop() {
+
+	cv::Mat work;
+	std::vector<uchar> jpeg;
+	std::vector<int> params = { cv::IMWRITE_JPEG_QUALITY, quality };
+
+	while (running) {
+		{
+			std::unique_lock<std::mutex> guard(frameLock);
+			frameReady.wait(guard, [this] { return hasPending || !running; });
+			if (!running) {
+				break;
+			}
+			//swap so post() can fill the other buffer while we encode
+			cv::swap(pending, work);
+			hasPending = false;
+		}
+
+		if (!cv::imencode(".jpg", work, jpeg, params)) {
+			continue;
+		}
+
+		char head[128];
+		int n = snprintf(head, sizeof(head),
+			"--vidframe\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n", jpeg.size());
+		std::shared_ptr<std::vector<uchar>> part = std::make_shared<std::vector<uchar>>();
+		part->reserve(n + jpeg.size() + 2);
+		part->insert(part->end(), head, head + n);
+		part->insert(part->end(), jpeg.begin(), jpeg.end());
+		part->push_back('\r');
+		part->push_back('\n');
+
+		{
+			std::lock_guard<std::mutex> guard(partLock);
+			latest = part;
+			latestSeq++;
+		}
+		encodedCount++;
+
+		uint64_t one = 1;
+		if (write(wakeFd, &one, sizeof(one)) < 0) {
+			//counter already non-zero, the io thread is awake anyway
+		}
+	}
+}
+
+void MjpegServer::acceptClients() {
+
+	for (;;) {
+		int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		Client* c = new Client();
+		c->fd = fd;
+		c->streaming = false;
+		c->wantWrite = false;
+		c->headerSent = 0;
+		c->partSent = 0;
+		c->partSeq = 0;
+
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = c;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+		connections.insert(c);
+	}
+}
+
+//reads until the end of the request headers. Returns false if the client went away.
+bool MjpegServer::readRequest(Client& c) {
+
+	char buf[1024];
+	for (;;) {
+		ssize_t r = recv(c.fd, buf, sizeof(buf), 0);
+		if (r == 0) {
+			return false;
+		}
+		if (r < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+		//once streaming, anything the client sends is ignored
+		if (c.streaming) {
+			continue;
+		}
+		c.request.append(buf, r);
+		if (c.request.find("\r\n\r\n") != std::string::npos || c.request.find("\n\n") != std::string::npos) {
+			c.streaming = true;
+			c.request.clear();
+			c.request.shrink_to_fit();
+			clientCount++;
+		}
+		else if (c.request.size() > MAX_REQUEST) {
+			return false;
+		}
+	}
+}
+
+//sends as much as the socket takes: the response header, the rest of the current part, then
+//the newest part if the client finished an older one. Returns false if the client went away.
+bool MjpegServer::flush(Client& c, const Part& newest, uint64_t newestSeq) {
+
+	for (;;) {
+		const char* data;
+		size_t left;
+
+		if (c.headerSent < sizeof(RESPONSE_HEADER) - 1) {
+			data = RESPONSE_HEADER + c.headerSent;
+			left = sizeof(RESPONSE_HEADER) - 1 - c.headerSent;
+		}
+		else {
+			//done with this part: jump to the newest one, skipping anything in between
+			if (!c.part || c.partSent == c.part->size()) {
+				if (!newest || newestSeq == c.partSeq) {
+					break;
+				}
+				c.part = newest;
+				c.partSeq = newestSeq;
+				c.partSent = 0;
+			}
+			data = reinterpret_cast<const char*>(c.part->data()) + c.partSent;
+			left = c.part->size() - c.partSent;
+		}
+
+		ssize_t w = send(c.fd, data, left, MSG_NOSIGNAL);
+		if (w < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			return false;
+		}
+
+		if (c.headerSent < sizeof(RESPONSE_HEADER) - 1) {
+			c.headerSent += w;
+		}
+		else {
+			c.partSent += w;
+		}
+	}
+
+	//only keep EPOLLOUT armed while there is something left to send, otherwise the
+	//level-triggered socket would wake us for every free byte of buffer
+	bool pendingData = c.headerSent < sizeof(RESPONSE_HEADER) - 1 ||
+		(c.part && c.partSent < c.part->size());
+	if (pendingData != c.wantWrite) {
+		c.wantWrite = pendingData;
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLRDHUP | (pendingData ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+		ev.data.ptr = &c;
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &ev);
+	}
+
+	//drop our reference to a fully sent part so old frames are freed promptly
+	if (c.part && c.partSent == c.part->size()) {
+		c.part.reset();
+		c.partSent = 0;
+	}
+	return true;
+}
+
+void MjpegServer::closeClient(Client* c) {
+
+	connections.erase(c);
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, c->fd, nullptr);
+	close(c->fd);
+	if (c->streaming) {
+		clientCount--;
+	}
+	delete c;
+}
+
+void MjpegServer::ioLoop() {
+
+	struct epoll_event events[64];
+
+	while (running) {
+		int n = epoll_wait(epollFd, events, 64, 500);
+
+		//newest part, picked up once per wakeup
+		Part newest;
+		uint64_t newestSeq;
+		{
+			std::lock_guard<std::mutex> guard(partLock);
+			newest = latest;
+			newestSeq = latestSeq;
+		}
+
+		bool newFrame = false;
+		for (int e = 0; e < n; e++) {
+			void* ptr = events[e].data.ptr;
+			if (ptr == nullptr) {
+				acceptClients();
+				continue;
+			}
+			if (ptr == this) {
+				uint64_t count;
+				if (read(wakeFd, &count, sizeof(count)) > 0) {
+					newFrame = true;
+				}
+				continue;
+			}
+
+			Client* c = static_cast<Client*>(ptr);
+			bool alive = !(events[e].events & (EPOLLERR | EPOLLHUP));
+			if (alive && (events[e].events & (EPOLLIN | EPOLLRDHUP))) {
+				alive = readRequest(*c) && !(events[e].events & EPOLLRDHUP);
+			}
+			if (alive && c->streaming) {
+				alive = flush(*c, newest, newestSeq);
+			}
+			if (!alive) {
+				closeClient(c);
+			}
+		}
+
+		//new frame: start it on every client that is idle; busy clients pick it up when done
+		if (newFrame) {
+			std::vector<Client*> idle;
+			for (Client* c : connections) {
+				if (c->streaming && !c->wantWrite) {
+					idle.push_back(c);
+				}
+			}
+			for (Client* c : idle) {
+				if (!flush(*c, newest, newestSeq)) {
+					closeClient(c);
+				}
+			}
+		}
+	}
+
+	while (!connections.empty()) {
+		closeClient(*connections.begin());
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+//MJPEG over HTTP output header
+//Serves the filtered feed as multipart/x-mixed-replace JPEG, which any browser can show.
+//Each frame is JPEG encoded once, on an encoder thread, and the same encoded buffer is shared by
+//every connected client. An epoll thread pushes it out over non-blocking sockets. A client that
+//is still busy with an older frame simply skips ahead to the newest one when it finishes, so
+//slow clients never queue more than the frame they are on.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+class MjpegServer {
+public:
+	MjpegServer();
+	~MjpegServer();
+
+	//listens on address:port (use 127.0.0.1 to keep it on loopback) and starts both threads
+	bool start(int port, const std::string& address = "0.0.0.0", int quality = 80);
+	//hands a frame to the encoder. Only the newest frame is kept, so this never waits on encoding
+	//or on clients - frames posted faster than they can be encoded are dropped.
+	void post(const cv::Mat& frame);
+	void stop();
+
+	int clients() const { return clientCount.load(); }
+	uint64_t encoded() const { return encodedCount.load(); }
+
+private:
+	struct Client;
+	typedef std::shared_ptr<const std::vector<uchar>> Part;
+
+	void encodeLoop();
+	void ioLoop();
+	void acceptClients();
+	bool readRequest(Client& c);
+	bool flush(Client& c, const Part& newest, uint64_t newestSeq);
+	void closeClient(Client* c);
+
+	int quality;
+	int listenFd;
+	int epollFd;
+	int wakeFd;
+	std::atomic<bool> running;
+
+	//newest posted frame waiting for the encoder
+	std::mutex frameLock;
+	std::condition_variable frameReady;
+	cv::Mat pending;
+	bool hasPending;
+
+	//newest encoded multipart part, shared by all clients
+	std::mutex partLock;
+	Part latest;
+	uint64_t latestSeq;
+
+	//connections, only touched by the io thread
+	std::unordered_set<Client*> connections;
+
+	std::atomic<int> clientCount;
+	std::atomic<uint64_t> encodedCount;
+	std::thread encoder;
+	std::thread io;
+};
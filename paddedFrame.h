@@ -0,0 +1,126 @@
+#pragma once
+//padded frame header (internal to the filter library)
+//A frame buffer with an apron of 'border' pixels on every side, filled once per frame by
+//replicating or reflecting the edge. Kernels can then read up to 'border' pixels past any edge,
+//so they run one straight loop over the whole image with no edge special cases.
+//Rows are 64-byte aligned (pixel 0 of every row starts on a cache line) for vector loads.
+
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+enum { PAD_REPLICATE, PAD_REFLECT };
+
+//maps position p into [lo, hi) the way the border mode extends an image:
+//replicate repeats the edge pixel (aaa|abcd|ddd), reflect mirrors without repeating it (cb|abcd|cb)
+static inline int padIndex(int p, int lo, int hi, int mode) {
+
+	if (mode == PAD_REFLECT && hi - lo > 1) {
+		while (p < lo || p >= hi) {
+			p = p < lo ? 2 * lo - p : 2 * (hi - 1) - p;
+		}
+		return p;
+	}
+	return std::min(std::max(p, lo), hi - 1);
+}
+
+template <typename T>
+class PaddedFrame {
+public:
+	PaddedFrame() : buffer(nullptr), capacity(0), width(0), height(0), channels(0), border(0), stride(0), origin(nullptr) {
+	}
+	~PaddedFrame() {
+		free(buffer);
+	}
+	PaddedFrame(const PaddedFrame&) = delete;
+	PaddedFrame& operator=(const PaddedFrame&) = delete;
+
+	//sizes the buffer for a w x h frame of cn channels; memory is only reallocated when it grows.
+	//Returns 0, or -1 if the memory can't be allocated (the frame is then empty until the next create)
+	int create(int w, int h, int cn, int b) {
+
+		width = w;
+		height = h;
+		channels = cn;
+		border = b;
+
+		//left apron rounded up to a whole cache line so pixel 0 of each row is aligned
+		size_t lead = (b * cn * sizeof(T) + 63) & ~static_cast<size_t>(63);
+		size_t rowBytes = lead + ((w + b) * cn * sizeof(T) + 63) / 64 * 64;
+		stride = rowBytes / sizeof(T);
+
+		size_t bytes = rowBytes * (h + 2 * b);
+		if (bytes > capacity) {
+			free(buffer);
+			buffer = static_cast<T*>(aligned_alloc(64, bytes));
+			capacity = buffer != nullptr ? bytes : 0;
+		}
+		if (buffer == nullptr) {
+			origin = nullptr;
+			return -1;
+		}
+		origin = buffer + b * stride + lead / sizeof(T);
+		return 0;
+	}
+
+	//pointer to pixel 0 of row i, valid for i in [-border, height + border) and
+	//for elements [-border * channels, (width + border) * channels) of that row
+	T* row(int i) const {
+		return origin + static_cast<std::ptrdiff_t>(i) * stride;
+	}
+
+	//copies a w x h source into the frame and fills the apron.
+	//haloTop/Bottom/Left/Right are how many real pixels exist past each edge of the source (it may
+	//be a window into a bigger image); those are used for the apron before the border mode kicks in.
+	//Returns -1 if the frame has no memory (create failed).
+	int fill(const T* data, size_t step, int haloTop, int haloBottom, int haloLeft, int haloRight, int mode) {
+
+		if (origin == nullptr) {
+			return -1;
+		}
+
+		haloTop = std::min(haloTop, border);
+		haloBottom = std::min(haloBottom, border);
+		haloLeft = std::min(haloLeft, border);
+		haloRight = std::min(haloRight, border);
+
+		int cn = channels;
+		for (int i = -border; i < height + border; i++) {
+			int si = padIndex(i, -haloTop, height + haloBottom, mode);
+			const T* sptr = reinterpret_cast<const T*>(reinterpret_cast<const char*>(data) + static_cast<std::ptrdiff_t>(si) * step);
+			T* dptr = row(i);
+
+			//real pixels, including any halo columns
+			memcpy(dptr - haloLeft * cn, sptr - haloLeft * cn, (width + haloLeft + haloRight) * cn * sizeof(T));
+
+			//apron columns past the halo
+			for (int j = -border; j < -haloLeft; j++) {
+				int sj = padIndex(j, -haloLeft, width + haloRight, mode);
+				for (int c = 0; c < cn; c++) {
+					dptr[j * cn + c] = sptr[sj * cn + c];
+				}
+			}
+			for (int j = width + haloRight; j < width + border; j++) {
+				int sj = padIndex(j, -haloLeft, width + haloRight, mode);
+				for (int c = 0; c < cn; c++) {
+					dptr[j * cn + c] = sptr[sj * cn + c];
+				}
+			}
+		}
+		return 0;
+	}
+
+	int cols() const { return width; }
+	int rows() const { return height; }
+
+private:
+	T* buffer;
+	size_t capacity;
+	int width;
+	int height;
+	int channels;
+	int border;
+	size_t stride;
+	T* origin;
+};
@@ -0,0 +1,194 @@
+//hardware performance counters
+//perf_event_open group per thread, read once per begin/end
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include "perfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static int64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+PerfCounters::PerfCounters() : leader(-1), opened(0), startEnabled(0), startRunning(0), startNs(0) {
+
+	for (int e = 0; e < EVENT_COUNT; e++) {
+		fds[e] = -1;
+		slot[e] = -1;
+		startValues[e] = 0;
+	}
+}
+
+PerfCounters::~PerfCounters() {
+	close();
+}
+
+bool PerfCounters::open() {
+
+	close();
+#ifdef __linux__
+	static const struct { uint32_t type; uint64_t config; } events[EVENT_COUNT] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },    //last level cache
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	};
+
+	int err = 0;
+	for (int e = 0; e < EVENT_COUNT; e++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[e].type;
+		attr.config = events[e].config;
+		//user space only, which is all the kernels run in and is allowed at perf_event_paranoid 2
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.disabled = leader < 0;
+
+		//this thread, any cpu; the first event that opens leads the group
+		int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+		if (fd < 0) {
+			if (err == 0) {
+				err = errno;
+			}
+			continue;
+		}
+		if (leader < 0) {
+			leader = fd;
+		}
+		fds[e] = fd;
+		slot[e] = opened++;
+	}
+
+	if (leader < 0) {
+		fprintf(stderr, "Performance counters unavailable (%s), timing only\n", strerror(err));
+		return false;
+	}
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+#else
+	fprintf(stderr, "Performance counters need Linux, timing only\n");
+	return false;
+#endif
+}
+
+void PerfCounters::close() {
+
+	for (int e = 0; e < EVENT_COUNT; e++) {
+		if (fds[e] >= 0) {
+			::close(fds[e]);
+		}
+		fds[e] = -1;
+		slot[e] = -1;
+	}
+	leader = -1;
+	opened = 0;
+}
+
+//one read returns every counter in the group plus how long the group was enabled and actually
+//counting (less than enabled when the pmu is shared and events are multiplexed)
+bool PerfCounters::readGroup(uint64_t* values, uint64_t& enabled, uint64_t& running) {
+
+	uint64_t buf[3 + EVENT_COUNT];
+	ssize_t want = static_cast<ssize_t>((3 + opened) * sizeof(uint64_t));
+	if (leader < 0 || read(leader, buf, sizeof(buf)) < want) {
+		return false;
+	}
+	enabled = buf[1];
+	running = buf[2];
+	for (int e = 0; e < opened; e++) {
+		values[e] = buf[3 + e];
+	}
+	return true;
+}
+
+void PerfCounters::begin() {
+
+	if (leader >= 0 && !readGroup(startValues, startEnabled, startRunning)) {
+		fprintf(stderr, "Lost the performance counters, timing only\n");
+		close();
+	}
+	startNs = nowNs();
+}
+
+void PerfCounters::end(const std::string& name, int64_t pixels) {
+
+	int64_t ns = nowNs() - startNs;
+	Totals& t = totals[name];
+	t.calls++;
+	t.pixels += pixels;
+	t.ms += ns / 1e6;
+
+	uint64_t values[EVENT_COUNT];
+	uint64_t enabled;
+	uint64_t running;
+	if (leader < 0 || !readGroup(values, enabled, running)) {
+		return;
+	}
+	//scale up for the time the group was multiplexed out
+	uint64_t ranFor = running - startRunning;
+	double scale = ranFor > 0 ? static_cast<double>(enabled - startEnabled) / ranFor : 0;
+	for (int e = 0; e < EVENT_COUNT; e++) {
+		if (slot[e] >= 0) {
+			t.counts[e] += (values[slot[e]] - startValues[slot[e]]) * scale;
+		}
+	}
+}
+
+void PerfCounters::report(FILE* out) const {
+
+	fprintf(out, "%-12s %8s %9s %8s", "filter", "calls", "ms/call", "ns/px");
+	if (hasEvent(CYCLES)) {
+		fprintf(out, " %8s", "cyc/px");
+	}
+	if (hasEvent(CYCLES) && hasEvent(INSTRUCTIONS)) {
+		fprintf(out, " %6s", "IPC");
+	}
+	if (hasEvent(L1D_MISSES)) {
+		fprintf(out, " %12s", "L1D miss/kpx");
+	}
+	if (hasEvent(LLC_MISSES)) {
+		fprintf(out, " %12s %8s", "LLC miss/kpx", "mem B/px");
+	}
+	if (hasEvent(BRANCH_MISSES)) {
+		fprintf(out, " %11s", "br miss/kpx");
+	}
+	fprintf(out, "\n");
+
+	for (const auto& it : totals) {
+		const Totals& t = it.second;
+		double px = t.pixels > 0 ? static_cast<double>(t.pixels) : 1;
+		fprintf(out, "%-12s %8lld %9.3f %8.3f", it.first.c_str(), static_cast<long long>(t.calls),
+			t.ms / t.calls, t.ms * 1e6 / px);
+		if (hasEvent(CYCLES)) {
+			fprintf(out, " %8.2f", t.counts[CYCLES] / px);
+		}
+		if (hasEvent(CYCLES) && hasEvent(INSTRUCTIONS)) {
+			fprintf(out, " %6.2f", t.counts[CYCLES] > 0 ? t.counts[INSTRUCTIONS] / t.counts[CYCLES] : 0.0);
+		}
+		if (hasEvent(L1D_MISSES)) {
+			fprintf(out, " %12.2f", t.counts[L1D_MISSES] * 1000 / px);
+		}
+		if (hasEvent(LLC_MISSES)) {
+			fprintf(out, " %12.2f %8.2f", t.counts[LLC_MISSES] * 1000 / px, t.counts[LLC_MISSES] * 64 / px);
+		}
+		if (hasEvent(BRANCH_MISSES)) {
+			fprintf(out, " %11.2f", t.counts[BRANCH_MISSES] * 1000 / px);
+		}
+		fprintf(out, "\n");
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+//hardware performance counter header
+//Wraps filter calls with Linux perf_event_open counters (cycles, instructions, L1D and LLC misses,
+//branch misses) for the calling thread and totals them per filter, so a report can tell whether
+//a kernel is bound by compute, cache or memory. Counts are reported per pixel: cycles/pixel, IPC,
+//misses per 1000 pixels and the bytes/pixel pulled from memory (LLC misses x 64 byte lines).
+//Where counters aren't permitted (perf_event_paranoid, containers, VMs without a PMU) or an
+//event is missing, those columns are left out and the rest, down to plain timing, still works.
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+
+class PerfCounters {
+public:
+	enum Event { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, EVENT_COUNT };
+
+	PerfCounters();
+	~PerfCounters();
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	//opens the counters for the calling thread. Returns false (and says why) if none could be
+	//opened; begin()/end() then only time the calls.
+	bool open();
+	void close();
+
+	//measure one call: begin() right before it, end() right after with the pixels it processed.
+	//Only work on the thread that called open() is counted.
+	void begin();
+	void end(const std::string& name, int64_t pixels);
+
+	//one line per name with the per-pixel metrics
+	void report(FILE* out) const;
+
+	bool hasCounters() const { return leader >= 0; }
+	bool hasEvent(Event e) const { return slot[e] >= 0; }
+
+private:
+	struct Totals {
+		int64_t calls = 0;
+		int64_t pixels = 0;
+		double ms = 0;
+		double counts[EVENT_COUNT] = {};
+	};
+
+	bool readGroup(uint64_t* values, uint64_t& enabled, uint64_t& running);
+
+	int fds[EVENT_COUNT];
+	int slot[EVENT_COUNT];    //position of each event in the group read, -1 if not open
+	int leader;
+	int opened;
+
+	uint64_t startValues[EVENT_COUNT];
+	uint64_t startEnabled;
+	uint64_t startRunning;
+	int64_t startNs;
+
+	std::map<std::string, Totals> totals;
+};
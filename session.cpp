@@ -0,0 +1,163 @@
+//session recording
+//raw frames + key timeline for deterministic replay of the video loop
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "session.h"
+
+//timeline format, one record per line (records are told apart by their tag, not by order):
+//  vidsession 1
+//  start <button> <shift> <shiftAmt>
+//  size <width> <height> <fps>
+//  f <frame> <time us>
+//  k <frame> <key> <shift> <shiftAmt>
+//keys are written as numbers so any key code survives the round trip
+
+
+SessionRecorder::SessionRecorder() : timeline(nullptr), started(false), count(0) {
+}
+
+SessionRecorder::~SessionRecorder() {
+	close();
+}
+
+bool SessionRecorder::open(const std::string& base, char button, int shift, int shiftAmt) {
+
+	close();
+	baseName = base;
+	timeline = fopen((base + ".session").c_str(), "w");
+	if (timeline == nullptr) {
+		fprintf(stderr, "Unable to create %s.session\n", base.c_str());
+		return false;
+	}
+	fprintf(timeline, "vidsession 1\n");
+	fprintf(timeline, "start %d %d %d\n", button, shift, shiftAmt);
+	started = false;
+	count = 0;
+	return true;
+}
+
+bool SessionRecorder::frame(const cv::Mat& frame, double fps) {
+
+	if (timeline == nullptr) {
+		return false;
+	}
+
+	//the frame file is opened on the first frame, cameras don't always deliver the size they report
+	if (!started) {
+		if (!frames.open(baseName + ".bgr", FRAME_RAW_BGR, frame.size())) {
+			return false;
+		}
+		fprintf(timeline, "size %d %d %g\n", frame.cols, frame.rows, fps > 0 ? fps : 30.0);
+		start = std::chrono::steady_clock::now();
+		started = true;
+	}
+
+	count++;
+	int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	fprintf(timeline, "f %lld %lld\n", static_cast<long long>(count), static_cast<long long>(us));
+	return frames.write(frame);
+}
+
+void SessionRecorder::key(char key, int shift, int shiftAmt) {
+
+	if (timeline == nullptr || !started) {
+		return;
+	}
+	fprintf(timeline, "k %lld %d %d %d\n", static_cast<long long>(count), key, shift, shiftAmt);
+}
+
+void SessionRecorder::close() {
+
+	if (timeline != nullptr) {
+		fclose(timeline);
+		timeline = nullptr;
+		fprintf(stderr, "Recorded %lld frames to %s.bgr / %s.session\n", static_cast<long long>(count),
+			baseName.c_str(), baseName.c_str());
+	}
+	frames.close();
+	started = false;
+}
+
+
+bool SessionReplay::open(const std::string& base, char& button, int& shift, int& shiftAmt) {
+
+	FILE* f = fopen((base + ".session").c_str(), "r");
+	if (f == nullptr) {
+		fprintf(stderr, "Unable to open %s.session\n", base.c_str());
+		return false;
+	}
+
+	char line[256];
+	cv::Size size;
+	double rate = 30;
+	events.clear();
+	pos = 0;
+	bool ok = fgets(line, sizeof(line), f) != nullptr && strncmp(line, "vidsession 1", 12) == 0;
+
+	while (ok && fgets(line, sizeof(line), f) != nullptr) {
+		long long n = 0;
+		long long t = 0;
+		int a = 0;
+		int b = 0;
+		int c = 0;
+
+		if (sscanf(line, "f %lld %lld", &n, &t) == 2) {
+			//frames are numbered from 1 and written in order
+			SessionEvent e;
+			e.timeUs = t;
+			e.key = -1;
+			e.shift = 0;
+			e.shiftAmt = 0;
+			events.push_back(e);
+		}
+		else if (sscanf(line, "k %lld %d %d %d", &n, &a, &b, &c) == 4) {
+			if (n < 1 || static_cast<size_t>(n) > events.size()) {
+				ok = false;
+				break;
+			}
+			events[n - 1].key = static_cast<char>(a);
+			events[n - 1].shift = b;
+			events[n - 1].shiftAmt = c;
+		}
+		else if (sscanf(line, "start %d %d %d", &a, &b, &c) == 3) {
+			button = static_cast<char>(a);
+			shift = b;
+			shiftAmt = c;
+		}
+		else if (sscanf(line, "size %d %d %lf", &size.width, &size.height, &rate) == 3) {
+			//the raw frame file has no header of its own
+		}
+	}
+	fclose(f);
+
+	if (!ok) {
+		fprintf(stderr, "%s.session is not a session timeline\n", base.c_str());
+		return false;
+	}
+	if (!frames.open(base + ".bgr", FRAME_RAW_BGR, size, rate)) {
+		return false;
+	}
+	return true;
+}
+
+bool SessionReplay::next(cv::Mat& frame, SessionEvent& event, bool paced) {
+
+	if (pos >= events.size() || !frames.read(frame)) {
+		return false;
+	}
+	event = events[pos];
+
+	//the clock starts on the first frame, later frames wait for their recorded offset
+	if (pos == 0) {
+		start = std::chrono::steady_clock::now();
+	}
+	else if (paced) {
+		std::this_thread::sleep_until(start + std::chrono::microseconds(event.timeUs - events[0].timeUs));
+	}
+	pos++;
+	return true;
+}
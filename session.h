@@ -0,0 +1,63 @@
+#pragma once
+//session recording header
+//A recorded session is the raw input frames (<base>.bgr, raw BGR so replay can map it) plus a
+//text timeline (<base>.session) with the time of every frame and every key press, together with
+//the color shift state at that moment. Replaying feeds the same frames and keys back through the
+//same loop, so a filter build can be profiled on exactly the same workload without a camera.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "frameIO.h"
+
+//what happened on one frame of a session
+struct SessionEvent {
+	int64_t timeUs;   //since the first frame
+	char key;         //key press handled on this frame, -1 if none
+	int shift;        //color shift state when the key was handled
+	int shiftAmt;
+};
+
+
+class SessionRecorder {
+public:
+	SessionRecorder();
+	~SessionRecorder();
+
+	//starts a session; button/shift/shiftAmt are the state before the first frame
+	bool open(const std::string& base, char button, int shift, int shiftAmt);
+	//call once per input frame, before the filter runs on it
+	bool frame(const cv::Mat& frame, double fps);
+	//call when a key is handled on the current frame, with the state before the key is applied
+	void key(char key, int shift, int shiftAmt);
+	void close();
+
+private:
+	std::string baseName;
+	FILE* timeline;
+	FrameWriter frames;
+	bool started;
+	int64_t count;
+	std::chrono::steady_clock::time_point start;
+};
+
+
+class SessionReplay {
+public:
+	//loads the timeline and maps the frames. button/shift/shiftAmt get the recorded start state.
+	bool open(const std::string& base, char& button, int& shift, int& shiftAmt);
+	//next frame and its event. With paced set it first waits until the frame's recorded time.
+	bool next(cv::Mat& frame, SessionEvent& event, bool paced);
+
+	cv::Size size() const { return frames.size(); }
+	double fps() const { return frames.fps(); }
+	size_t length() const { return events.size(); }
+
+private:
+	FrameReader frames;
+	std::vector<SessionEvent> events;
+	size_t pos = 0;
+	std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,100 @@
+/*
+	Example consumer for the shared-memory frame ring published by vidDisplay -S <name>.
+
+	Maps the ring, waits for new frames and looks at them in place. Once a second it prints how
+	many frames it saw, how many it skipped (published while it was busy) and the publish-to-read
+	latency. -show displays the frames, -slow <ms> simulates a slow reader (the publisher is never
+	held up by it, the reader just skips frames).
+
+	usage: shmConsumer <name> [-show] [-slow ms]
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+#include "shmRing.h"
+
+static int64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[]) {
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <name> [-show] [-slow ms]\n", argv[0]);
+		return -1;
+	}
+
+	bool show = false;
+	int slowMs = 0;
+	for (int a = 2; a < argc; a++) {
+		if (strcmp(argv[a], "-show") == 0) {
+			show = true;
+		}
+		else if (strcmp(argv[a], "-slow") == 0 && a + 1 < argc) {
+			slowMs = atoi(argv[++a]);
+		}
+	}
+
+	ShmSubscriber ring;
+	if (!ring.open(argv[1])) {
+		return -1;
+	}
+
+	//start from whatever is newest now
+	uint64_t last = ring.latest();
+	int seen = 0;
+	uint64_t skipped = 0;
+	int torn = 0;
+	double latencyMs = 0;
+	int64_t reportAt = nowNs() + 1000000000;
+
+	for (;;) {
+		ShmFrame f;
+		if (ring.acquire(f, last, 1000)) {
+			double lat = (nowNs() - f.timestampNs) / 1e6;
+
+			//the frame is used straight from shared memory...
+			if (show) {
+				cv::imshow("Consumer", f.image);
+				if (cv::waitKey(1) == 'q') {
+					break;
+				}
+			}
+			if (slowMs > 0) {
+				usleep(slowMs * 1000);
+			}
+
+			//...so check afterwards that the publisher didn't lap us while we were looking
+			if (ring.validate(f)) {
+				if (last != 0) {
+					skipped += f.frame - last - 1;
+				}
+				seen++;
+				latencyMs += lat;
+			}
+			else {
+				torn++;
+			}
+			last = f.frame;
+		}
+
+		if (nowNs() >= reportAt) {
+			printf("frames %d  skipped %llu  overwritten %d  latency %.2f ms\n", seen,
+				static_cast<unsigned long long>(skipped), torn, seen > 0 ? latencyMs / seen : 0.0);
+			fflush(stdout);
+			seen = 0;
+			skipped = 0;
+			torn = 0;
+			latencyMs = 0;
+			reportAt = nowNs() + 1000000000;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,299 @@
+//shared-memory frame ring
+//seqlock protected slots in POSIX shared memory with futex wakeups
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <opencv2/opencv.hpp>
+#include "shmRing.h"
+
+static const uint32_t RING_MAGIC = 0x56464d52; //'VFMR'
+static const uint32_t RING_VERSION = 1;
+
+//rounds n up to a whole cache line so slot headers and rows of different slots never share one
+static size_t cacheAlign(size_t n) {
+	return (n + 63) & ~static_cast<size_t>(63);
+}
+
+static int64_t monotonicNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+//process-shared futex (the ring lives in shared memory, so no FUTEX_PRIVATE_FLAG)
+static void futexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeoutMs) {
+	struct timespec ts;
+	ts.tv_sec = timeoutMs / 1000;
+	ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+static void futexWakeAll(std::atomic<uint32_t>* word) {
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static ShmSlotHeader* slotAt(uchar* base, uint32_t slot) {
+	ShmRingHeader* h = reinterpret_cast<ShmRingHeader*>(base);
+	return reinterpret_cast<ShmSlotHeader*>(base + h->slotOffset + slot * h->slotBytes);
+}
+
+static uchar* slotData(ShmSlotHeader* s) {
+	return reinterpret_cast<uchar*>(s) + cacheAlign(sizeof(ShmSlotHeader));
+}
+
+
+ShmPublisher::ShmPublisher() : base(nullptr), length(0), count(0) {
+}
+
+ShmPublisher::~ShmPublisher() {
+	close();
+}
+
+bool ShmPublisher::open(const std::string& name, cv::Size maxSize, int channels, int slots) {
+
+	close();
+	shmName = name[0] == '/' ? name : "/" + name;
+
+	size_t frameBytes = static_cast<size_t>(maxSize.width) * maxSize.height * channels;
+	size_t slotBytes = cacheAlign(sizeof(ShmSlotHeader)) + cacheAlign(frameBytes);
+	size_t slotOffset = cacheAlign(sizeof(ShmRingHeader));
+	length = slotOffset + slotBytes * slots;
+
+	//start from a fresh object so readers of an old ring don't see a half-initialised header
+	shm_unlink(shmName.c_str());
+	int fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to create shared memory %s: %s\n", shmName.c_str(), strerror(errno));
+		return false;
+	}
+	if (ftruncate(fd, length) != 0) {
+		fprintf(stderr, "Unable to size shared memory %s: %s\n", shmName.c_str(), strerror(errno));
+		::close(fd);
+		shm_unlink(shmName.c_str());
+		return false;
+	}
+	void* m = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED) {
+		fprintf(stderr, "Unable to map shared memory %s: %s\n", shmName.c_str(), strerror(errno));
+		shm_unlink(shmName.c_str());
+		return false;
+	}
+	base = static_cast<uchar*>(m);
+
+	//ftruncate zero-fills, so every slot starts with an even (free) sequence
+	ShmRingHeader* h = reinterpret_cast<ShmRingHeader*>(base);
+	h->version = RING_VERSION;
+	h->slotCount = slots;
+	h->maxWidth = maxSize.width;
+	h->maxHeight = maxSize.height;
+	h->maxChannels = channels;
+	h->slotBytes = slotBytes;
+	h->slotOffset = slotOffset;
+	h->latest.store(0);
+	h->notify.store(0);
+	h->waiters.store(0);
+	//magic goes in last so a reader that opens early never trusts the header before it's filled
+	h->magic.store(RING_MAGIC, std::memory_order_release);
+
+	count = 0;
+	return true;
+}
+
+void ShmPublisher::close() {
+
+	if (base != nullptr) {
+		munmap(base, length);
+		shm_unlink(shmName.c_str());
+		base = nullptr;
+	}
+	length = 0;
+}
+
+bool ShmPublisher::publish(const cv::Mat& frame) {
+
+	if (base == nullptr) {
+		return false;
+	}
+	ShmRingHeader* h = reinterpret_cast<ShmRingHeader*>(base);
+
+	//any frame type fits as long as it is no bigger than the slot
+	size_t rowBytes = frame.cols * frame.elemSize();
+	if (rowBytes * frame.rows > h->slotBytes - cacheAlign(sizeof(ShmSlotHeader))) {
+		return false;
+	}
+
+	//frame numbers start at 1 so latest == 0 means nothing published
+	count++;
+	ShmSlotHeader* s = slotAt(base, count % h->slotCount);
+	uchar* data = slotData(s);
+
+	//seqlock write: odd sequence, then data, then the next even sequence
+	uint64_t seq = s->seq.load(std::memory_order_relaxed);
+	s->seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	s->frame = count;
+	s->timestampNs = monotonicNs();
+	s->width = frame.cols;
+	s->height = frame.rows;
+	s->type = frame.type();
+	s->step = rowBytes;
+	if (frame.isContinuous()) {
+		memcpy(data, frame.data, rowBytes * frame.rows);
+	}
+	else {
+		for (int i = 0; i < frame.rows; i++) {
+			memcpy(data + i * rowBytes, frame.ptr(i), rowBytes);
+		}
+	}
+
+	s->seq.store(seq + 2, std::memory_order_release);
+	h->latest.store(count, std::memory_order_release);
+
+	//wake sleepers; the syscall is skipped entirely while nobody is waiting
+	h->notify.fetch_add(1, std::memory_order_release);
+	if (h->waiters.load(std::memory_order_seq_cst) > 0) {
+		futexWakeAll(&h->notify);
+	}
+	return true;
+}
+
+
+ShmSubscriber::ShmSubscriber() : base(nullptr), length(0) {
+}
+
+ShmSubscriber::~ShmSubscriber() {
+	close();
+}
+
+bool ShmSubscriber::open(const std::string& name) {
+
+	close();
+	std::string shmName = name[0] == '/' ? name : "/" + name;
+
+	//readers need write access only for the waiters count in the header
+	int fd = shm_open(shmName.c_str(), O_RDWR, 0);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open shared memory %s: %s\n", shmName.c_str(), strerror(errno));
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ShmRingHeader)) {
+		::close(fd);
+		return false;
+	}
+	void* m = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED) {
+		return false;
+	}
+	base = static_cast<uchar*>(m);
+	length = st.st_size;
+
+	//the magic is loaded first: it pairs with the publisher's release store, so the fields after it
+	//are complete once it is seen
+	ShmRingHeader* h = reinterpret_cast<ShmRingHeader*>(base);
+	if (h->magic.load(std::memory_order_acquire) != RING_MAGIC || h->version != RING_VERSION ||
+		h->slotCount == 0 || h->slotBytes < cacheAlign(sizeof(ShmSlotHeader)) ||
+		h->slotOffset + h->slotBytes * h->slotCount > length) {
+		fprintf(stderr, "%s is not a frame ring\n", shmName.c_str());
+		close();
+		return false;
+	}
+	return true;
+}
+
+void ShmSubscriber::close() {
+
+	if (base != nullptr) {
+		munmap(base, length);
+		base = nullptr;
+	}
+	length = 0;
+}
+
+uint64_t ShmSubscriber::latest() const {
+
+	if (base == nullptr) {
+		return 0;
+	}
+	return reinterpret_cast<ShmRingHeader*>(base)->latest.load(std::memory_order_acquire);
+}
+
+bool ShmSubscriber::acquire(ShmFrame& f, uint64_t after, int timeoutMs) {
+
+	if (base == nullptr) {
+		return false;
+	}
+	ShmRingHeader* h = reinterpret_cast<ShmRingHeader*>(base);
+	int64_t deadline = monotonicNs() + static_cast<int64_t>(timeoutMs) * 1000000;
+
+	for (;;) {
+		uint64_t n = h->latest.load(std::memory_order_acquire);
+		if (n > after) {
+			uint32_t slot = n % h->slotCount;
+			ShmSlotHeader* s = slotAt(base, slot);
+			uint64_t seq = s->seq.load(std::memory_order_acquire);
+
+			//odd = being rewritten, other frame = the ring lapped us; either way look again
+			if ((seq & 1) != 0) {
+				continue;
+			}
+
+			//copy the slot header, then check the sequence: if the publisher lapped us meanwhile
+			//the copy may be torn (say half of a gray to BGR switch) and must not be used
+			uint64_t frame = s->frame;
+			int64_t timestampNs = s->timestampNs;
+			uint32_t width = s->width;
+			uint32_t height = s->height;
+			uint32_t type = s->type;
+			uint32_t step = s->step;
+			f.slot = slot;
+			f.seq = seq;
+			if (!validate(f) || frame != n) {
+				continue;
+			}
+
+			//and only build a view that is a real Mat type and lies inside the slot
+			uint64_t dataBytes = h->slotBytes - cacheAlign(sizeof(ShmSlotHeader));
+			if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX || type != CV_MAT_TYPE(type) ||
+				step < static_cast<uint64_t>(width) * CV_ELEM_SIZE(type) || static_cast<uint64_t>(height) * step > dataBytes) {
+				fprintf(stderr, "Frame %llu has a bad header\n", static_cast<unsigned long long>(n));
+				return false;
+			}
+			f.frame = frame;
+			f.timestampNs = timestampNs;
+			f.image = cv::Mat(static_cast<int>(height), static_cast<int>(width), static_cast<int>(type), slotData(s), step);
+			return true;
+		}
+
+		int64_t left = deadline - monotonicNs();
+		if (left <= 0) {
+			return false;
+		}
+
+		//register as a waiter, then re-check so a frame published in between isn't missed
+		uint32_t observed = h->notify.load(std::memory_order_acquire);
+		h->waiters.fetch_add(1, std::memory_order_seq_cst);
+		if (h->latest.load(std::memory_order_seq_cst) <= after) {
+			futexWait(&h->notify, observed, static_cast<int>(left / 1000000) + 1);
+		}
+		h->waiters.fetch_sub(1, std::memory_order_seq_cst);
+	}
+}
+
+bool ShmSubscriber::validate(const ShmFrame& f) const {
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slotAt(base, f.slot)->seq.load(std::memory_order_relaxed) == f.seq;
+}
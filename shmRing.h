@@ -0,0 +1,89 @@
+#pragma once
+//shared-memory frame ring header
+//The publisher (vidDisplay) copies each filtered frame into the next slot of a POSIX shared-memory
+//ring. Consumers on the same host map the ring and look at frames in place, without copying.
+//
+//Every slot is guarded by a seqlock: the slot sequence is odd while the publisher is writing it.
+//Readers never lock anything, so a slow reader can't stall the publisher - it just finds that
+//the slot it was reading got overwritten (validate() fails) and moves on to the newest frame.
+//Waiting readers sleep on a futex in the ring header that the publisher bumps on every frame.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+//layout shared between processes - fixed size types only
+struct ShmRingHeader {
+	std::atomic<uint32_t> magic;     //RING_MAGIC once the rest of the header is filled in
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t maxWidth;
+	uint32_t maxHeight;
+	uint32_t maxChannels;
+	uint64_t slotBytes;   //stride between slots including the slot header
+	uint64_t slotOffset;  //offset of slot 0 from the start of the mapping
+
+	std::atomic<uint64_t> latest;    //frame number of the newest complete frame, 0 = none yet
+	std::atomic<uint32_t> notify;    //futex word, incremented for every published frame
+	std::atomic<uint32_t> waiters;   //readers sleeping on notify; the publisher skips the wake when 0
+};
+
+struct ShmSlotHeader {
+	std::atomic<uint64_t> seq;       //seqlock, odd while being written
+	uint64_t frame;                  //frame number stored in this slot
+	int64_t timestampNs;             //CLOCK_MONOTONIC time of publication
+	uint32_t width;
+	uint32_t height;
+	uint32_t type;                   //cv::Mat type
+	uint32_t step;                   //bytes per row
+};
+
+
+//one published frame as seen by a reader
+struct ShmFrame {
+	cv::Mat image;       //view straight onto the shared slot, no copy
+	uint64_t frame;
+	int64_t timestampNs;
+	uint32_t slot;
+	uint64_t seq;        //slot sequence when the frame was acquired
+};
+
+
+class ShmPublisher {
+public:
+	ShmPublisher();
+	~ShmPublisher();
+
+	//creates (or replaces) the ring /name with slots big enough for maxSize x channels frames
+	bool open(const std::string& name, cv::Size maxSize, int channels = 3, int slots = 4);
+	//copies frame into the next slot and wakes sleeping readers. Never blocks on readers.
+	bool publish(const cv::Mat& frame);
+	void close();
+
+private:
+	std::string shmName;
+	uchar* base;
+	size_t length;
+	uint64_t count;
+};
+
+
+class ShmSubscriber {
+public:
+	ShmSubscriber();
+	~ShmSubscriber();
+
+	bool open(const std::string& name);
+	//waits up to timeoutMs for a frame newer than 'after' and returns a view of the newest one
+	bool acquire(ShmFrame& f, uint64_t after, int timeoutMs = 1000);
+	//true if the slot was not overwritten while f was being used - call after reading f.image
+	bool validate(const ShmFrame& f) const;
+	void close();
+
+	uint64_t latest() const;
+
+private:
+	uchar* base;
+	size_t length;
+};
@@ -0,0 +1,282 @@
+/*
+	Filters still images too big to hold in memory, a strip of rows at a time.
+
+	Reads a binary PPM (P6, 8 bit) in horizontal strips, runs the filter on each strip together
+	with the halo rows its kernels need from the strips above and below, and writes the output
+	strip before reading the next one. Memory use is a few strips whatever the image size.
+	The output is the same as filtering the whole image in one piece.
+
+		b = blur5x5           c = cartoon
+		p = pixelate          a = histogram EQ (fake HDR), two passes over the input
+
+	-rows N sets the strip height (default 256). -border is the same as for vidDisplay. -perf
+	counts cycles, instructions, cache and branch misses of the filter calls and prints them per pixel.
+
+	usage: stripFilter -k b|c|p|a [-rows N] [-border replicate|reflect] [-perf] <in.ppm> <out.ppm>
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <sys/resource.h>
+#include <opencv2/opencv.hpp>
+#include "filter.h"
+#include "perfCounters.h"
+
+//filter settings, the same as vidDisplay's keys
+static const int PIXEL_SIZE = 10;
+static const int CARTOON_LAYERS = 5;
+static const int CARTOON_SENSITIVITY = 50;
+
+//rows past a strip edge the blur and sobel kernels read
+static const int HALO = 2;
+
+//reads the next whitespace separated number of a PPM header, skipping # comments
+static bool headerValue(FILE* f, long long& v) {
+
+	int c = fgetc(f);
+	while (c != EOF && (isspace(c) || c == '#')) {
+		if (c == '#') {
+			while (c != EOF && c != '\n') {
+				c = fgetc(f);
+			}
+		}
+		c = fgetc(f);
+	}
+	if (c == EOF || !isdigit(c)) {
+		return false;
+	}
+	v = 0;
+	while (c != EOF && isdigit(c)) {
+		v = v * 10 + (c - '0');
+		c = fgetc(f);
+	}
+	//the single whitespace after the last header value is part of the header
+	return c != EOF && isspace(c);
+}
+
+//opens a P6 file and leaves it at the first pixel
+static FILE* openPPM(const char* path, int& width, int& height) {
+
+	FILE* f = fopen(path, "rb");
+	if (f == nullptr) {
+		fprintf(stderr, "Unable to open %s\n", path);
+		return nullptr;
+	}
+	char magic[2];
+	long long w, h, maxval;
+	if (fread(magic, 1, 2, f) != 2 || magic[0] != 'P' || magic[1] != '6' ||
+		!headerValue(f, w) || !headerValue(f, h) || !headerValue(f, maxval) ||
+		w <= 0 || h <= 0 || w > 1 << 30 || h > 1 << 30 || maxval != 255) {
+		fprintf(stderr, "%s is not an 8 bit binary PPM (P6)\n", path);
+		fclose(f);
+		return nullptr;
+	}
+	width = static_cast<int>(w);
+	height = static_cast<int>(h);
+	return f;
+}
+
+//reads rows into m (CV_8UC3, PPM order is RGB so they are swapped to BGR in place)
+static bool readRows(FILE* f, cv::Mat& m) {
+
+	for (int i = 0; i < m.rows; i++) {
+		if (fread(m.ptr(i), 3, m.cols, f) != static_cast<size_t>(m.cols)) {
+			return false;
+		}
+	}
+	cv::cvtColor(m, m, cv::COLOR_RGB2BGR);
+	return true;
+}
+
+static bool writeRows(FILE* f, const cv::Mat& m, cv::Mat& rgb) {
+
+	cv::cvtColor(m, rgb, cv::COLOR_BGR2RGB);
+	for (int i = 0; i < rgb.rows; i++) {
+		if (fwrite(rgb.ptr(i), 3, rgb.cols, f) != static_cast<size_t>(rgb.cols)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//one pass over the image: calls strip(roi) for every strip of 'rows' rows. roi is a window into a
+//buffer that also holds up to 'halo' real rows above and below it, which the kernels pick up as
+//their apron. The buffer slides down the image, so only rows + 2 * halo rows are ever held.
+template <typename StripFn>
+static bool forEachStrip(FILE* in, int width, int height, int rows, int halo, StripFn strip) {
+
+	cv::Mat buf(rows + 2 * halo, width, CV_8UC3);
+	int first = 0;      //image row held in buf row 0
+	int have = 0;       //rows held
+	int next = 0;       //next image row to read
+
+	for (int y0 = 0; y0 < height; y0 += rows) {
+		int y1 = std::min(height, y0 + rows);
+
+		//drop the rows no longer needed as halo
+		int keep = std::max(0, y0 - halo);
+		if (keep > first) {
+			int drop = keep - first;
+			memmove(buf.ptr(0), buf.ptr(drop), (have - drop) * buf.step);
+			have -= drop;
+			first = keep;
+		}
+
+		//read this strip and the halo below it
+		int want = std::min(height, y1 + halo);
+		if (want > next) {
+			cv::Mat fresh = buf.rowRange(have, have + want - next);
+			if (!readRows(in, fresh)) {
+				fprintf(stderr, "Input ends early at row %d\n", next);
+				return false;
+			}
+			have += want - next;
+			next = want;
+		}
+
+		//a header over just the rows held, so the kernels never see stale rows past them as halo
+		cv::Mat held(have, width, CV_8UC3, buf.data, buf.step);
+		cv::Mat roi = held.rowRange(y0 - first, y1 - first);
+		if (!strip(roi)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+
+	char key = 0;
+	int rows = 256;
+	const char* inPath = nullptr;
+	const char* outPath = nullptr;
+	bool perf = false;
+
+	for (int a = 1; a < argc; a++) {
+		bool hasValue = a + 1 < argc;
+		if (strcmp(argv[a], "-k") == 0 && hasValue) {
+			key = argv[++a][0];
+		}
+		else if (strcmp(argv[a], "-rows") == 0 && hasValue) {
+			rows = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-border") == 0 && hasValue) {
+			setFilterBorder(strcmp(argv[++a], "reflect") == 0 ? FILTER_BORDER_REFLECT : FILTER_BORDER_REPLICATE);
+		}
+		else if (strcmp(argv[a], "-perf") == 0) {
+			perf = true;
+		}
+		else if (inPath == nullptr) {
+			inPath = argv[a];
+		}
+		else if (outPath == nullptr) {
+			outPath = argv[a];
+		}
+		else {
+			inPath = nullptr;
+			break;
+		}
+	}
+	if (strchr("bcpa", key) == nullptr || key == 0 || rows <= 0 || inPath == nullptr || outPath == nullptr) {
+		fprintf(stderr, "usage: %s -k b|c|p|a [-rows N] [-border replicate|reflect] [-perf] <in.ppm> <out.ppm>\n", argv[0]);
+		return -1;
+	}
+
+	int width, height;
+	FILE* in = openPPM(inPath, width, height);
+	if (in == nullptr) {
+		return -1;
+	}
+	off_t pixels = ftello(in);
+
+	//pixelate blocks start every PIXEL_SIZE rows from the top, so strips must too
+	int halo = HALO;
+	if (key == 'p') {
+		rows = (rows + PIXEL_SIZE - 1) / PIXEL_SIZE * PIXEL_SIZE;
+		halo = 0;
+	}
+	else if (key == 'a') {
+		halo = 0;
+	}
+
+	FILE* out = fopen(outPath, "wb");
+	if (out == nullptr) {
+		fprintf(stderr, "Unable to write %s\n", outPath);
+		fclose(in);
+		return -1;
+	}
+	fprintf(out, "P6\n%d %d\n255\n", width, height);
+
+	PerfCounters counters;
+	if (perf) {
+		counters.open();
+	}
+
+	int64_t start = cv::getTickCount();
+	cv::Mat result;
+	cv::Mat hsv;
+	cv::Mat eq;
+	cv::Mat rgb;
+	bool ok = true;
+
+	if (key == 'a') {
+		//first pass counts the values of the whole image, the second equalizes every strip with them
+		int64_t histo[256] = { 0 };
+		ok = forEachStrip(in, width, height, rows, 0, [&](cv::Mat& roi) {
+			cv::cvtColor(roi, hsv, cv::COLOR_BGR2HSV);
+			counters.begin();
+			hdrHistogram(hsv, histo);
+			counters.end("hdrHistogram", static_cast<int64_t>(roi.total()));
+			return true;
+		});
+		if (ok && fseeko(in, pixels, SEEK_SET) != 0) {
+			fprintf(stderr, "Unable to rewind %s for the second pass\n", inPath);
+			ok = false;
+		}
+		if (ok) {
+			ok = forEachStrip(in, width, height, rows, 0, [&](cv::Mat& roi) {
+				cv::cvtColor(roi, hsv, cv::COLOR_BGR2HSV);
+				counters.begin();
+				hdrApply(hsv, eq, histo);
+				counters.end("hdrApply", static_cast<int64_t>(roi.total()));
+				cv::cvtColor(eq, result, cv::COLOR_HSV2BGR);
+				return writeRows(out, result, rgb);
+			});
+		}
+	}
+	else {
+		const char* name = key == 'b' ? "blur5x5" : key == 'c' ? "cartoon" : "pixelate";
+		ok = forEachStrip(in, width, height, rows, halo, [&](cv::Mat& roi) {
+			counters.begin();
+			if (key == 'b') {
+				blur5x5(roi, result);
+			}
+			else if (key == 'c') {
+				cartoon(roi, result, CARTOON_LAYERS, CARTOON_SENSITIVITY);
+			}
+			else {
+				pixelate(roi, result, PIXEL_SIZE);
+			}
+			counters.end(name, static_cast<int64_t>(roi.total()));
+			return writeRows(out, result, rgb);
+		});
+	}
+
+	fclose(in);
+	if (fclose(out) != 0 || !ok) {
+		fprintf(stderr, "Failed writing %s\n", outPath);
+		return -1;
+	}
+
+	double secs = (cv::getTickCount() - start) / cv::getTickFrequency();
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(stderr, "%dx%d in strips of %d rows: %.2f s (%.1f Mpixel/s), peak memory %ld MB\n", width, height,
+		rows, secs, secs > 0 ? static_cast<double>(width) * height / secs / 1e6 : 0.0, usage.ru_maxrss / 1024);
+	if (perf) {
+		counters.report(stderr);
+	}
+	return 0;
+}
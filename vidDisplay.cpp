@@ -3,18 +3,49 @@
 
 	Establishes webcam feed, filters the frame based on input,
 	then displays the frame.
+
+	Options:
+		-i <path>   read frames from a raw BGR or .y4m file instead of the camera ("-" = stdin)
+		-o <path>   write every filtered frame to a raw BGR or .y4m file ("-" = stdout)
+		-f raw|y4m  stream format for -i/-o when it can't be told from the file extension
+		-s WxH      frame size of raw BGR input
+		-k <key>    filter to start with (same keys as below)
+		-H          headless: no window or key handling, runs until the input ends
+		-S <name>   publish every filtered frame to the shared-memory ring /name (see shmConsumer)
+		-w [addr:]port  serve the filtered feed as MJPEG over HTTP (default address 0.0.0.0)
+		-t          also show half and quarter size previews of the filtered frame
+		-record <base>  record the session: input frames to <base>.bgr, key timeline to <base>.session
+		-replay <base>  replay a recorded session instead of the camera, as fast as possible
+		-paced      replay at the recorded frame times instead
+		-border replicate|reflect  how blur/sobel/gradX extend the image past its edges
+		-g <keys>   start in grid view showing these filters side by side (v toggles it, default nbxmcl)
+		-keyframe K cartoon keeps its edge mask and refreshes it every K frames, one stripe per frame
+		-stripes S  spread each edge refresh over S frames (default K)
+		-scenecut T redo the whole edge mask at once when the mean sampled pixel change is over T (default 12, 0 = off)
+		-perf       count cycles, instructions, cache and branch misses per filter and print them per pixel at exit
+		-roi x,y,w,h  filter only this rectangle of the frame, in place (repeat for more regions)
+		-mask <image> filter only where this image is non-zero (resized to the frame; with -roi, within the regions)
 */
 
 #include <cstdio>
 #include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string>
 #include <opencv2/opencv.hpp>
 #include "filter.h"
+#include "frameIO.h"
+#include "shmRing.h"
+#include "mjpegServer.h"
+#include "session.h"
+#include "frameCache.h"
+#include "perfCounters.h"
 
 //global used for screenshot numbering
 int screenNum = 0;
 
 
-//screenshot saves the passed Mat as an jpg image. 
+//screenshot saves the passed Mat as an jpg image.
 //Warning: There is no handling for filename conflicts. Writes to exe directory
 int screenshot(cv::Mat &frame) {
 
@@ -22,51 +53,643 @@ int screenshot(cv::Mat &frame) {
 
 	filename += (std::to_string(screenNum) + ".jpg");
 	cv::imwrite(filename, frame);
-	printf("Screenshot taken.");
+	fprintf(stderr, "Screenshot taken.");
 	screenNum++;
 	return 0;
 }
 
-int main(int argc, char* argv[]) {
 
-	cv::VideoCapture* capdev;
+//state the filters carry from one frame to the next
+struct FilterState {
+	//last frame for the movement filter. Under -roi each region's pixels are kept in nextFrame,
+	//which becomes lastFrame once every region is done (regions may overlap).
+	cv::Mat lastFrame;
+	cv::Mat nextFrame;
 
-	//open the video device
-	capdev = new cv::VideoCapture(0);
-	if (!capdev->isOpened()) {
-		printf("Unable to open video device\n");
-		return -1;
+	//variables for color shift filter
+	int shift = 0;
+	int shiftAmt = 5;
+
+	//gray, blur, sobel and quantize results of the current frame. A filter takes a result from here
+	//when its producer's bit (1 << CacheProducer) is set in shared, i.e. another filter running on the
+	//same frame needs it too (see sharedProducers); otherwise it uses its own fused kernel, which is
+	//faster than building the separate frames.
+	FrameCache cache;
+	unsigned shared = 0;
+
+	//cartoon edge keyframing (-keyframe) and the time spent in cartoon, reported at exit
+	bool keyframe = false;
+	CartoonState cartoon;
+	int64_t cartoonFrames = 0;
+	double cartoonMs = 0;
+};
+
+
+//the cache producers (as 1 << CacheProducer bits) that more than one of the filters in keys would
+//use on the same frame. The keyframed cartoon keeps its own edges, so it shares nothing.
+unsigned sharedProducers(const std::string &keys, bool keyframe) {
+
+	int users[CACHE_QUANTIZE + 1] = {};
+	for (char k : keys) {
+		bool cartoon = k == 'c' && !keyframe;
+		users[CACHE_GRAY] += k == 'h';
+		users[CACHE_BLUR] += k == 'b' || k == 'l' || cartoon;
+		users[CACHE_SOBEL_X] += k == 'x' || k == 'm' || cartoon;
+		users[CACHE_SOBEL_Y] += k == 'y' || k == 'm' || cartoon;
+	}
 
+	unsigned shared = 0;
+	for (int p = 0; p <= CACHE_QUANTIZE; p++) {
+		if (users[p] > 1) {
+			shared |= 1u << p;
+		}
 	}
+	return shared;
+}
+
+//true if producer's result is taken from state.cache this frame
+bool isShared(const FilterState &state, CacheProducer producer) {
+	return (state.shared & (1u << producer)) != 0;
+}
 
-	//get some properties of the image
-	cv::Size refS((int)capdev->get(cv::CAP_PROP_FRAME_WIDTH),
-		(int)capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
-	printf("Expected size: %d %d \n", refS.width, refS.height);
 
-	cv::namedWindow("Video", 1); //identifies a window
-	cv::Mat frame;
+//moves the color shift on by one frame, bouncing between 0 and 200
+void advanceShift(FilterState &state) {
+
+	if (state.shift + state.shiftAmt > 200) {
+		state.shiftAmt = -state.shiftAmt;
+	}
+	else if (state.shift + state.shiftAmt < 0) {
+		state.shiftAmt = abs(state.shiftAmt);
+	}
+	state.shift += state.shiftAmt;
+}
+
+
+//runs the filter selected by button on frame and leaves a displayable image in disp.
+//disp is written in place if it already has the right size and type (the grid passes its tiles),
+//so it must not share frame's buffer; n leaves it as a header on frame.
+//state.cache must have been started on frame (beginFrame) before this is called.
+//If pyr is given it also gets half and quarter size previews - filters that can build them in
+//the same pass do, the rest are resized afterwards
+int applyFilter(char button, cv::Mat &frame, cv::Mat &disp, FilterState &state, std::vector<cv::Mat> *pyr) {
+
+	bool pyrDone = false;
+
+	//show normal frame with no filter
+	if (button == 'n') {
+		disp = frame;
+	}
+
+	// a keypress switches to histogram EQ  aka fake HDR
+	else if (button == 'a') {
+		cv::Mat frameHSV;
+		cv::Mat newHSV;
+		//converting to hue/sat/val
+		cv::cvtColor(frame, frameHSV, cv::COLOR_BGR2HSV);
+
+		//run histogram
+		hdrEQ(frameHSV, newHSV);
+
+		//convert back to BGR for display
+		cv::cvtColor(newHSV, disp, cv::COLOR_HSV2BGR);
+	}
+
+	// u keypress switches to color shifting filter
+	else if (button == 'u') {
+		colorshift(frame, disp, state.shift, pyr);
+		pyrDone = true;
+		advanceShift(state);
+	}
+
+	//i key press switch to movement filter
+	else if (button == 'i') {
+		movement(frame, state.lastFrame, disp, 150);
+		//save this frame as last frame
+		frame.copyTo(state.lastFrame);
+	}
+
+	// p key press switch to pixelation filter
+	else if (button == 'p') {
+		int pixelSize = 10;
+		pixelate(frame, disp, pixelSize);
+	}
+
+	// m key press switch to combined sobel gradient magnitude filter
+	else if (button == 'm') {
+		//x and y sobel come from the frame cache
+		magnitude(state.cache, disp);
+	}
+
+	// c key press switch to cartoon filter
+	else if (button == 'c') {
+		//variables for black line sensitivity (lower for more edges)
+		//and quantized layers
+		int sensitivity = 50;
+		int layers = 5;
+		int64_t start = cv::getTickCount();
+		if (state.keyframe) {
+			cartoonKeyframed(frame, disp, layers, sensitivity, state.cartoon, pyr);
+		}
+		else if (isShared(state, CACHE_BLUR) || isShared(state, CACHE_SOBEL_X) || isShared(state, CACHE_SOBEL_Y)) {
+			cartoon(state.cache, disp, layers, sensitivity, pyr);
+		}
+		else {
+			cartoon(frame, disp, layers, sensitivity, pyr);
+		}
+		state.cartoonMs += (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+		state.cartoonFrames++;
+		pyrDone = true;
+	}
+
+	// l key press switch blur/quantize filter
+	else if (button == 'l') {
+		//quantized straight into disp from the blur the other tiles use
+		if (isShared(state, CACHE_BLUR)) {
+			cv::Mat blurred = state.cache.get(CACHE_BLUR);
+			quantize(blurred, disp, 4);
+		}
+		else {
+			blurQuantize(frame, disp, 4, pyr);
+			pyrDone = true;
+		}
+	}
+
+	// x key press switch to x sobel using a 3x3 filter
+	else if (button == 'x') {
+		//8-bit display output straight from the kernel, or from the 16-bit sobel the other tiles use
+		if (isShared(state, CACHE_SOBEL_X)) {
+			cv::Mat sx = state.cache.get(CACHE_SOBEL_X);
+			absSaturate(sx, disp);
+		}
+		else {
+			sobelX3x3(frame, disp, true);
+		}
+	}
+
+	// y key press switch to y sobel using a 3x3 filter
+	else if (button == 'y') {
+		if (isShared(state, CACHE_SOBEL_Y)) {
+			cv::Mat sy = state.cache.get(CACHE_SOBEL_Y);
+			absSaturate(sy, disp);
+		}
+		else {
+			sobelY3x3(frame, disp, true);
+		}
+	}
+
+	// b key press switches to gaussian blur using blur5x5 with convolution
+	else if (button == 'b') {
+		if (isShared(state, CACHE_BLUR)) {
+			state.cache.get(CACHE_BLUR).copyTo(disp);
+		}
+		else {
+			blur5x5(frame, disp, pyr);
+			pyrDone = true;
+		}
+	}
+
+	//  e key press switches to grayscale using cvtColor
+	else if (button == 'e') {
+		cvtColor(frame, disp, CV_16F);
+	}
+
+	//  h key press switches to grayscale using the average of b,g,r placed in a uchar matrix
+	else if (button == 'h') {
+		if (isShared(state, CACHE_GRAY)) {
+			disp = state.cache.get(CACHE_GRAY);
+		}
+		else {
+			grayScale(frame, disp);
+		}
+	}
+
+	//g key press switches to gradX filter (edge detection from tutorial)
+	else if (button == 'g') {
+		gradX(frame, disp, true);
+	}
+
+	//unknown filter, show the frame as is
+	else {
+		disp = frame;
+	}
+
+	if (pyr != nullptr && !pyrDone) {
+		pyr->resize(2);
+		cv::resize(disp, (*pyr)[0], cv::Size(disp.cols / 2, disp.rows / 2), 0, 0, cv::INTER_AREA);
+		cv::resize((*pyr)[0], (*pyr)[1], cv::Size(disp.cols / 4, disp.rows / 4), 0, 0, cv::INTER_AREA);
+	}
+
+	return 0;
+}
+
+
+//name of the filter on a key, for reports
+const char* filterName(char button) {
+
+	switch (button) {
+	case 'n': return "none";
+	case 'a': return "hdrEQ";
+	case 'u': return "colorshift";
+	case 'i': return "movement";
+	case 'p': return "pixelate";
+	case 'm': return "magnitude";
+	case 'c': return "cartoon";
+	case 'l': return "blurQuantize";
+	case 'x': return "sobelX3x3";
+	case 'y': return "sobelY3x3";
+	case 'b': return "blur5x5";
+	case 'e': return "cvtColor";
+	case 'h': return "grayScale";
+	case 'g': return "gradX";
+	}
+	return "none";
+}
+
+
+//the filter on a key for filterRegions, with the same settings as applyFilter. Color shift and
+//movement use state like the whole frame versions (the caller moves the shift on and swaps in
+//nextFrame once per frame), histogram EQ equalizes each region by its own histogram, and cartoon
+//is the plain one (-keyframe keeps one edge mask for the whole frame).
+RegionFilter regionFilter(char button, FilterState &state) {
+
+	switch (button) {
+	case 'a': return [](cv::Mat &s, cv::Mat &d, cv::Rect) {
+		cv::Mat hsv;
+		cv::Mat eq;
+		cv::cvtColor(s, hsv, cv::COLOR_BGR2HSV);
+		int ret = hdrEQ(hsv, eq);
+		cv::cvtColor(eq, d, cv::COLOR_HSV2BGR);
+		return ret;
+	};
+	case 'u': return [&state](cv::Mat &s, cv::Mat &d, cv::Rect) { return colorshift(s, d, state.shift); };
+	case 'i': return [&state](cv::Mat &s, cv::Mat &d, cv::Rect r) {
+		//compared with the same part of the last raw frame, and this one's raw pixels kept for the next
+		cv::Mat last = state.lastFrame(r);
+		cv::Mat next = state.nextFrame(r);
+		s.copyTo(next);
+		return movement(s, last, d, 150);
+	};
+	case 'p': return [](cv::Mat &s, cv::Mat &d, cv::Rect) { return pixelate(s, d, 10); };
+	case 'c': return [](cv::Mat &s, cv::Mat &d, cv::Rect) { return cartoon(s, d, 5, 50); };
+	case 'l': return [](cv::Mat &s, cv::Mat &d, cv::Rect) { return blurQuantize(s, d, 4); };
+	case 'x': return [](cv::Mat &s, cv::Mat &d, cv::Rect) { return sobelX3x3(s, d, true); };
+	case 'y': return [](cv::Mat &s, cv::Mat &d, cv::Rect) { return sobelY3x3(s, d, true); };
+	case 'b': return [](cv::Mat &s, cv::Mat &d, cv::Rect) { return blur5x5(s, d); };
+	case 'e': return [](cv::Mat &s, cv::Mat &d, cv::Rect) {
+		cv::cvtColor(s, d, CV_16F);
+		return 0;
+	};
+	case 'h': return [](cv::Mat &s, cv::Mat &d, cv::Rect) { return grayScale(s, d); };
+	case 'g': return [](cv::Mat &s, cv::Mat &d, cv::Rect) { return gradX(s, d, true); };
+	case 'm': return [](cv::Mat &s, cv::Mat &d, cv::Rect) {
+		//the frame cache holds whole frame sobels, a region makes its own
+		cv::Mat sx;
+		cv::Mat sy;
+		sobelX3x3(s, sx);
+		sobelY3x3(s, sy);
+		return magnitude(sx, sy, d);
+	};
+	}
+	return RegionFilter();
+}
+
+
+//grid view: every filter in keys runs on the same frame concurrently, each straight into its tile
+//of canvas (tiles are frame sized, laid out row by row). Each tile gets its key and filter time.
+//Shared intermediates come from state.cache, so their cost shows up on whichever tile needed them first.
+int applyGrid(const std::string &keys, cv::Mat &frame, cv::Mat &canvas, FilterState &state) {
+
+	int n = static_cast<int>(keys.size());
+	int cols = static_cast<int>(ceil(sqrt(static_cast<double>(n))));
+	int rows = (n + cols - 1) / cols;
+	cv::Size canvasSize(frame.cols * cols, frame.rows * rows);
+
+	//allocated once, unused tiles stay black
+	if (canvas.size() != canvasSize || canvas.type() != CV_8UC3) {
+		canvas = cv::Mat::zeros(canvasSize, CV_8UC3);
+	}
+
+	cv::parallel_for_(cv::Range(0, n), [&](const cv::Range &range) {
+		for (int t = range.start; t < range.end; t++) {
+			cv::Mat tile = canvas(cv::Rect((t % cols) * frame.cols, (t / cols) * frame.rows, frame.cols, frame.rows));
+			cv::Mat out = tile;
+
+			int64_t start = cv::getTickCount();
+			applyFilter(keys[t], frame, out, state, nullptr);
+
+			//filters with a 16-bit or gray result (or none at all, like n) can't write into the tile
+			if (out.data != tile.data) {
+				cv::Mat out8 = out;
+				if (out.depth() != CV_8U) {
+					cv::convertScaleAbs(out, out8);
+				}
+				if (out8.channels() == 1) {
+					cv::cvtColor(out8, tile, cv::COLOR_GRAY2BGR);
+				}
+				else {
+					out8.copyTo(tile);
+				}
+			}
+			double ms = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+			char label[32];
+			snprintf(label, sizeof(label), "%c %.1f ms", keys[t], ms);
+			cv::putText(tile, label, cv::Point(8, 24), cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 255), 2);
+		}
+	});
+
+	return 0;
+}
+
+
+int main(int argc, char* argv[]) {
+
+	//command line options
+	std::string inPath;
+	std::string outPath;
+	std::string shmName;
+	std::string webAddress = "0.0.0.0";
+	int webPort = 0;
+	const char* formatName = nullptr;
+	cv::Size rawSize;
+	bool headless = false;
+	bool thumbnails = false;
+	std::string recordBase;
+	std::string replayBase;
+	bool paced = false;
+	std::string gridKeys = "nbxmcl";
+	bool grid = false;
+	int keyframe = 0;
+	int stripes = 0;
+	double sceneCut = -1;
+	std::vector<cv::Rect> regions;
+	std::string maskPath;
+	bool perf = false;
 
 	//keypress variables
 	char button = 'n';
 	bool screen = false;
 
-	//init for movement filter
-	cv::Mat lastFrame;
+	for (int a = 1; a < argc; a++) {
+		bool hasValue = a + 1 < argc;
+		if (strcmp(argv[a], "-i") == 0 && hasValue) {
+			inPath = argv[++a];
+		}
+		else if (strcmp(argv[a], "-o") == 0 && hasValue) {
+			outPath = argv[++a];
+		}
+		else if (strcmp(argv[a], "-f") == 0 && hasValue) {
+			formatName = argv[++a];
+		}
+		else if (strcmp(argv[a], "-s") == 0 && hasValue) {
+			if (sscanf(argv[++a], "%dx%d", &rawSize.width, &rawSize.height) != 2) {
+				fprintf(stderr, "Bad frame size %s (expected WxH)\n", argv[a]);
+				return -1;
+			}
+		}
+		else if (strcmp(argv[a], "-k") == 0 && hasValue) {
+			button = argv[++a][0];
+		}
+		else if (strcmp(argv[a], "-S") == 0 && hasValue) {
+			shmName = argv[++a];
+		}
+		else if (strcmp(argv[a], "-w") == 0 && hasValue) {
+			std::string spec = argv[++a];
+			size_t colon = spec.rfind(':');
+			if (colon != std::string::npos) {
+				webAddress = spec.substr(0, colon);
+				spec = spec.substr(colon + 1);
+			}
+			webPort = atoi(spec.c_str());
+		}
+		else if (strcmp(argv[a], "-record") == 0 && hasValue) {
+			recordBase = argv[++a];
+		}
+		else if (strcmp(argv[a], "-replay") == 0 && hasValue) {
+			replayBase = argv[++a];
+		}
+		else if (strcmp(argv[a], "-paced") == 0) {
+			paced = true;
+		}
+		else if (strcmp(argv[a], "-border") == 0 && hasValue) {
+			setFilterBorder(strcmp(argv[++a], "reflect") == 0 ? FILTER_BORDER_REFLECT : FILTER_BORDER_REPLICATE);
+		}
+		else if (strcmp(argv[a], "-g") == 0 && hasValue) {
+			//each filter once, in the order given
+			gridKeys.clear();
+			for (const char* k = argv[++a]; *k; k++) {
+				if (gridKeys.find(*k) == std::string::npos) {
+					gridKeys += *k;
+				}
+			}
+			grid = !gridKeys.empty();
+		}
+		else if (strcmp(argv[a], "-keyframe") == 0 && hasValue) {
+			keyframe = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-stripes") == 0 && hasValue) {
+			stripes = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-scenecut") == 0 && hasValue) {
+			sceneCut = atof(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-roi") == 0 && hasValue) {
+			cv::Rect r;
+			if (sscanf(argv[++a], "%d,%d,%d,%d", &r.x, &r.y, &r.width, &r.height) != 4 || r.width <= 0 || r.height <= 0) {
+				fprintf(stderr, "Bad region %s (expected x,y,w,h)\n", argv[a]);
+				return -1;
+			}
+			regions.push_back(r);
+		}
+		else if (strcmp(argv[a], "-mask") == 0 && hasValue) {
+			maskPath = argv[++a];
+		}
+		else if (strcmp(argv[a], "-perf") == 0) {
+			perf = true;
+		}
+		else if (strcmp(argv[a], "-t") == 0) {
+			thumbnails = true;
+		}
+		else if (strcmp(argv[a], "-H") == 0) {
+			headless = true;
+		}
+		else {
+			fprintf(stderr, "usage: %s [-i in] [-o out] [-f raw|y4m] [-s WxH] [-k key] [-H] [-S name] [-w [addr:]port] [-t]\n"
+				"       [-record base] [-replay base [-paced]] [-border replicate|reflect] [-g keys]\n"
+				"       [-keyframe K [-stripes S] [-scenecut T]] [-perf] [-roi x,y,w,h ...] [-mask image]\n",
+				argv[0]);
+			return -1;
+		}
+	}
 
-	//variables for color shift filter
-	int shift = 0;
-	int shiftAmt = 5;
+	cv::VideoCapture* capdev = nullptr;
+	FrameReader reader;
+	FrameWriter writer;
+	ShmPublisher publisher;
+	MjpegServer web;
+	SessionRecorder recorder;
+	SessionReplay replay;
+	cv::Size refS;
+	double fps = 30;
+
+	//filter state kept between frames (movement, color shift and cartoon keyframing)
+	FilterState state;
+	if (keyframe > 1 && (!regions.empty() || !maskPath.empty())) {
+		fprintf(stderr, "-keyframe keeps one edge mask for the whole frame, cartoon in -roi/-mask regions runs without it\n");
+	}
+	if (keyframe > 1) {
+		state.keyframe = true;
+		state.cartoon.refreshEvery = keyframe;
+		state.cartoon.stripes = stripes > 0 ? stripes : keyframe;
+		if (sceneCut >= 0) {
+			state.cartoon.diffThreshold = sceneCut;
+		}
+	}
+
+	if (!replayBase.empty()) {
+		//a replay brings its own frames and starting state
+		if (!replay.open(replayBase, button, state.shift, state.shiftAmt)) {
+			return -1;
+		}
+		refS = replay.size();
+		fps = replay.fps();
+		fprintf(stderr, "Replaying %zu frames from %s%s\n", replay.length(), replayBase.c_str(),
+			paced ? " at recorded pace" : "");
+	}
+	else if (!inPath.empty()) {
+		//raw/y4m input replaces the camera
+		FrameFormat inFormat = formatName ? (strcmp(formatName, "y4m") == 0 ? FRAME_Y4M : FRAME_RAW_BGR)
+			: formatFromPath(inPath);
+		if (!reader.open(inPath, inFormat, rawSize)) {
+			return -1;
+		}
+		refS = reader.size();
+		fps = reader.fps();
+		fprintf(stderr, "Reading %s (%s)\n", inPath.c_str(), reader.isMapped() ? "mapped" : "stream");
+	}
+	else {
+		//open the video device
+		capdev = new cv::VideoCapture(0);
+		if (!capdev->isOpened()) {
+			fprintf(stderr, "Unable to open video device\n");
+			delete capdev;
+			return -1;
+
+		}
+
+		//get some properties of the image
+		refS = cv::Size((int)capdev->get(cv::CAP_PROP_FRAME_WIDTH),
+			(int)capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
+		fps = capdev->get(cv::CAP_PROP_FPS);
+	}
+	fprintf(stderr, "Expected size: %d %d \n", refS.width, refS.height);
+	fprintf(stderr, "Filter kernels: %s\n", filterIsa());
+
+	if (!outPath.empty()) {
+		FrameFormat outFormat = formatName ? (strcmp(formatName, "y4m") == 0 ? FRAME_Y4M : FRAME_RAW_BGR)
+			: formatFromPath(outPath);
+		if (!writer.open(outPath, outFormat, refS, fps)) {
+			delete capdev;
+			return -1;
+		}
+	}
+
+	if (!shmName.empty()) {
+		if (!publisher.open(shmName, refS)) {
+			delete capdev;
+			return -1;
+		}
+		fprintf(stderr, "Publishing frames to /%s\n", shmName.c_str());
+	}
+
+	if (webPort > 0) {
+		if (!web.start(webPort, webAddress)) {
+			delete capdev;
+			return -1;
+		}
+		fprintf(stderr, "Serving MJPEG on http://%s:%d/\n", webAddress.c_str(), webPort);
+	}
+
+	if (!headless) {
+		cv::namedWindow("Video", 1); //identifies a window
+	}
+	cv::Mat frame;
+	cv::Mat disp;
+	std::vector<cv::Mat> previews;
+	cv::Mat canvas;
+
+	//-roi / -mask: filters that can run on part of a frame are applied in place to just those pixels
+	cv::Mat maskImage;
+	cv::Mat mask;
+	if (!maskPath.empty()) {
+		maskImage = cv::imread(maskPath, cv::IMREAD_GRAYSCALE);
+		if (maskImage.empty()) {
+			fprintf(stderr, "Unable to read mask %s\n", maskPath.c_str());
+			delete capdev;
+			return -1;
+		}
+	}
+	bool partial = !regions.empty() || !maskImage.empty();
+
+	if (!recordBase.empty() && !recorder.open(recordBase, button, state.shift, state.shiftAmt)) {
+		delete capdev;
+		return -1;
+	}
+
+	//counters are per thread, so only the single filter view is measured, not the grid's workers
+	PerfCounters counters;
+	if (perf) {
+		counters.open();
+	}
+
+	SessionEvent event;
+	int64_t frameCount = 0;
+	int64_t loopStart = cv::getTickCount();
 
 	for (;;) {
-		*capdev >> frame; //get a new frame from the cam, treat as a stream
+		if (!replayBase.empty()) {
+			if (!replay.next(frame, event, paced)) {
+				frame = cv::Mat();
+			}
+		}
+		else if (capdev != nullptr) {
+			*capdev >> frame; //get a new frame from the cam, treat as a stream
+		}
+		else if (!reader.read(frame)) {
+			frame = cv::Mat();
+		}
 		if (frame.empty()) {
-			printf("frame is empty\n");
+			fprintf(stderr, "frame is empty\n");
 			break;
 		}
+		frameCount++;
+		//anything cached for the previous frame is stale from here on
+		state.cache.beginFrame(frameCount, frame);
+		if (!recordBase.empty()) {
+			recorder.frame(frame, fps);
+		}
 
 		//see if there is a keystroke
-		char key = cv::waitKey(10);
+		char key;
+		if (!replayBase.empty()) {
+			//replayed keys come with the color shift state they were pressed in
+			key = event.key;
+			if (key != -1) {
+				state.shift = event.shift;
+				state.shiftAmt = event.shiftAmt;
+			}
+			//keep the window responsive, but only q is taken from the keyboard during a replay
+			if (!headless && cv::waitKey(1) == 'q') {
+				key = 'q';
+			}
+		}
+		else {
+			key = headless ? -1 : cv::waitKey(10);
+		}
+		if (key != -1 && !recordBase.empty()) {
+			recorder.key(key, state.shift, state.shiftAmt);
+		}
 		if (key == 'q') {
 			break;
 		}
@@ -89,14 +712,26 @@ int main(int argc, char* argv[]) {
 		case 'u':
 		case 'a':
 			button = key;
+			grid = false;
 			break;
 		//case i works on the last frame, so it starts by copying the current frame
 		case 'i':
 			button = key;
-			frame.copyTo(lastFrame);
+			grid = false;
+			frame.copyTo(state.lastFrame);
+			break;
+		//v toggles the grid view of gridKeys
+		case 'v':
+			grid = !grid && !gridKeys.empty();
 			break;
 		}
-		
+
+		//movement started from the command line (or in the grid) has no last frame yet
+		bool moving = grid ? gridKeys.find('i') != std::string::npos : button == 'i';
+		if (moving && state.lastFrame.size() != frame.size()) {
+			frame.copyTo(state.lastFrame);
+		}
+
 		//screenshot handler
 		if (key == 's'){
 			screen = true;
@@ -105,218 +740,108 @@ int main(int argc, char* argv[]) {
 			screen = false;
 		}
 
-		//show normal frame with no filter
-		if (button == 'n') {
-			cv::imshow("Video", frame);
-			button = 'n';
-			if (screen == true) {
-				screenshot(frame);
-			}
-		}
-
-		else {
+		//only the grid runs several filters on one frame, so only then are their intermediates shared
+		state.shared = grid ? sharedProducers(gridKeys, state.keyframe) : 0;
 
-			// a keypress switches to histogram EQ  aka fake HDR
-			if (button == 'a') {
-				cv::Mat final;
-				cv::Mat frameHSV;
-				cv::Mat newHSV;
-				//converting to hue/sat/val
-				cv::cvtColor(frame, frameHSV, cv::COLOR_BGR2HSV);
-
-				//run histogram
-				hdrEQ(frameHSV,newHSV);
-
-				//convert back to BGR and display
-				cv::cvtColor(newHSV, final, cv::COLOR_HSV2BGR);
-				cv::imshow("Video", final);
-				if (screen == true) {
-					screenshot(final);
-				}
-			}
+		//with -roi / -mask the filter runs on just those pixels of frame, in place
+		RegionFilter byRegion = partial && !grid ? regionFilter(button, state) : RegionFilter();
 
-			// u keypress switches to color shifting filter
-			if (button == 'u') {
-				cv::Mat colordisp;
-				colorshift(frame, colordisp, shift);
-				cv::imshow("Video", colordisp);
-				if (screen == true) {
-					screenshot(colordisp);
-				}
-				if (shift + shiftAmt > 200){
-					shiftAmt = -shiftAmt;
-				}
-				else if (shift + shiftAmt < 0) {
-					shiftAmt = abs(shiftAmt);
-				}
-				shift += shiftAmt;
+		//in grid view the window shows the whole canvas, the other outputs get the first tile
+		if (grid) {
+			applyGrid(gridKeys, frame, canvas, state);
+			disp = canvas(cv::Rect(0, 0, frame.cols, frame.rows));
+		}
+		else if (byRegion) {
+			if (!maskImage.empty() && mask.size() != frame.size()) {
+				cv::resize(maskImage, mask, frame.size(), 0, 0, cv::INTER_NEAREST);
 			}
-
-
-			//i key press switch to movement filter
-			if (button == 'i') {
-				cv::Mat movedisp;
-
-				movement(frame, lastFrame, movedisp, 150);
-				cv::Mat blurdisp;
-				cv::imshow("Video", movedisp);
-				button = 'i';
-				if (screen == true) {
-					screenshot(movedisp);
-				}
-				//save this frame as last frame
-				frame.copyTo(lastFrame);
-
+			if (button == 'i' && state.nextFrame.size() != frame.size()) {
+				state.lastFrame.copyTo(state.nextFrame);
 			}
-
-			// p key press switch to pixelation filter
-			if (button == 'p') {
-				cv::Mat pixeldisp;
-				int pixelSize = 10;
-				pixelate(frame, pixeldisp,pixelSize);
-				cv::imshow("Video", pixeldisp);
-				button = 'p';
-				if (screen == true) {
-					screenshot(pixeldisp);
-				}
-
+			//only the regions are filtered (and counted), the rest of frame is left as it came
+			int64_t pixels = 0;
+			for (const cv::Rect &r : regions) {
+				pixels += (r & cv::Rect(0, 0, frame.cols, frame.rows)).area();
 			}
-
-
-
-			// m key press switch to combined sobel gradient magnitude filter
-			if (button == 'm'){
-				cv::Mat xsobelsrc;
-				cv::Mat ysobelsrc;
-				cv::Mat magdisp;
-				//need to generate x and y sobel src first, then call magnitude with those as params
-				sobelX3x3(frame, xsobelsrc);
-				sobelY3x3(frame, ysobelsrc);
-				//generating magnitude
-				magnitude(xsobelsrc, ysobelsrc, magdisp);
-				cv::imshow("Video", magdisp);
-				button = 'm';
-				if (screen == true) {
-					screenshot(magdisp);
-				}
+			if (regions.empty()) {
+				pixels = cv::boundingRect(mask).area();
 			}
-
-
-
-			// c key press switch to combined sobel gradient magnitude
-			else if (button == 'c') {
-				cv::Mat cartdsp;
-				//variables for black line sensitivity (lower for more edges)
-				//and quantized layers
-				int sensitivity = 50;
-				int layers = 5;
-				cartoon(frame, cartdsp, layers, sensitivity);
-				cv::imshow("Video", cartdsp);
-				button = 'c';
-				if (screen == true) {
-					screenshot(cartdsp);
-				}
-
+			if (perf) {
+				counters.begin();
 			}
-
-			// l key press switch blur/quantize filter
-			else if (button == 'l') {
-				cv::Mat quantsrc;
-				blurQuantize(frame, quantsrc, 4);
-				cv::imshow("Video", quantsrc);
-				button = 'l';
-				if (screen == true) {
-					screenshot(quantsrc);
-				}
-
+			filterRegions(frame, regions, byRegion, mask);
+			if (perf) {
+				counters.end(filterName(button), pixels);
 			}
-
-			// x key press switch to x sobel using a 3x3 filter
-			else if (button == 'x') {
-				cv::Mat xsobelsrc;
-				cv::Mat xsobeldisp;
-				sobelX3x3(frame, xsobelsrc);
-				cv::convertScaleAbs(xsobelsrc, xsobeldisp);
-				cv::imshow("Video", xsobeldisp);
-				button = 'x';
-				if (screen == true) {
-					screenshot(xsobeldisp);
-				}
-				
+			//once per frame, however many regions there are
+			if (button == 'u') {
+				advanceShift(state);
 			}
-
-			// y key press switch to y sobel using a 3x3 filter
-			else if (button == 'y') {
-				cv::Mat ysobelsrc;
-				cv::Mat ysobeldisp;
-				sobelY3x3(frame, ysobelsrc);
-				cv::convertScaleAbs(ysobelsrc, ysobeldisp);
-				cv::imshow("Video", ysobeldisp);
-				button = 'y';
-				if (screen == true) {
-					screenshot(ysobeldisp);
-				}
-
+			else if (button == 'i') {
+				cv::swap(state.lastFrame, state.nextFrame);
 			}
-
-			// b key press switches to gaussian blur using blur5x5 with convolution
-			else if (button == 'b') {
-				cv::Mat blursrc;
-				blur5x5(frame, blursrc);
-				cv::imshow("Video", blursrc);
-				button = 'b';		
-				if (screen == true) {
-					screenshot(blursrc);
-				}
-
+			//n shows the frame, now filtered in place, and makes its previews
+			applyFilter('n', frame, disp, state, thumbnails ? &previews : nullptr);
+		}
+		else {
+			//n (and the -roi path) leave disp as a header on the frame, and the camera and pipe
+			//reader refill that same buffer. Filters write into a disp of the right size in place,
+			//so it is dropped first, otherwise the output would overwrite the input it reads
+			if (disp.datastart == frame.datastart) {
+				disp.release();
 			}
-
-
-			//  e key press switches to grayscale using cvtColor
-			else if (button == 'e') {
-
-				cv::Mat graysrc;
-				cvtColor(frame, graysrc, CV_16F);
-				cv::imshow("Video", graysrc);
-				button = 'e';
-				if (screen == true) {
-					screenshot(graysrc);
-				}
+			if (perf) {
+				counters.begin();
 			}
-
-
-			//  h key press switches to grayscale using the average of b,g,r placed in a uchar matrix
-			else if (button == 'h') {
-
-				cv::Mat graysrc;
-				grayScale(frame, graysrc);
-				cv::imshow("Video", graysrc);
-				button = 'h';
-				if (screen == true) {
-					screenshot(graysrc);
-				}
+			applyFilter(button, frame, disp, state, thumbnails ? &previews : nullptr);
+			if (perf) {
+				counters.end(filterName(button), static_cast<int64_t>(frame.total()));
 			}
+		}
+		cv::Mat &shown = grid ? canvas : disp;
 
-
-			//g key press switches to gradX filter (edge detection from tutorial)
-			else if (button == 'g') {
-
-				cv::Mat gradsrc;
-				gradX(frame, gradsrc);
-				cv::Mat displaysrc;
-				cv::convertScaleAbs(gradsrc, displaysrc);
-				cv::imshow("Video", displaysrc);
-				button = 'g';
-				if (screen == true) {
-					screenshot(displaysrc);
-				}
+		if (!headless) {
+			cv::imshow("Video", shown);
+			if (thumbnails && !grid) {
+				cv::imshow("Video 1/2", previews[0]);
+				cv::imshow("Video 1/4", previews[1]);
 			}
 		}
+		if (screen == true) {
+			screenshot(shown);
+		}
+		if (!outPath.empty() && !writer.write(disp)) {
+			fprintf(stderr, "Unable to write frame, stopping\n");
+			break;
+		}
+		if (!shmName.empty()) {
+			publisher.publish(disp);
+		}
+		if (webPort > 0) {
+			web.post(disp);
+		}
+	}
 
+	if (!replayBase.empty()) {
+		double secs = (cv::getTickCount() - loopStart) / cv::getTickFrequency();
+		fprintf(stderr, "Replayed %lld frames in %.3f s (%.3f ms/frame)\n", static_cast<long long>(frameCount),
+			secs, frameCount > 0 ? secs * 1000 / frameCount : 0.0);
+	}
 
+	if (perf) {
+		counters.report(stderr);
+	}
+	if (state.cartoonFrames > 0) {
+		fprintf(stderr, "cartoon: %lld frames, %.3f ms/frame", static_cast<long long>(state.cartoonFrames),
+			state.cartoonMs / state.cartoonFrames);
+		if (state.keyframe) {
+			fprintf(stderr, " (edges every %d frames over %d stripes, %lld full refreshes)",
+				state.cartoon.refreshEvery, state.cartoon.stripes, static_cast<long long>(state.cartoon.fullRefreshes));
+		}
+		fprintf(stderr, "\n");
 	}
 
 	delete capdev;
 	return 0;
 
-}
\ No newline at end of file
+}